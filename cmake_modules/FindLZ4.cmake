@@ -0,0 +1,29 @@
+# - Try to find the LZ4 compression library
+# Once done this will define
+#
+#  LZ4_FOUND - system has LZ4
+#  LZ4_INCLUDE_DIRS - the LZ4 include directory
+#  LZ4_LIBRARIES - the libraries needed to use LZ4
+
+FIND_PACKAGE(PkgConfig)
+PKG_CHECK_MODULES(PC_LZ4 liblz4)
+
+FIND_PATH(LZ4_INCLUDE_DIR lz4.h
+   HINTS
+   ${PC_LZ4_INCLUDEDIR}
+   ${PC_LZ4_INCLUDE_DIRS}
+   )
+
+FIND_LIBRARY(LZ4_LIBRARY NAMES lz4
+   HINTS
+   ${PC_LZ4_LIBDIR}
+   ${PC_LZ4_LIBRARY_DIRS}
+   )
+
+SET(LZ4_LIBRARIES ${LZ4_LIBRARY})
+SET(LZ4_INCLUDE_DIRS ${LZ4_INCLUDE_DIR})
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LZ4 DEFAULT_MSG LZ4_LIBRARIES LZ4_INCLUDE_DIRS)
+
+MARK_AS_ADVANCED(LZ4_INCLUDE_DIR LZ4_LIBRARY)
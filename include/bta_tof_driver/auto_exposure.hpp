@@ -0,0 +1,148 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_AUTO_EXPOSURE_HPP_
+#define _BTA_AUTO_EXPOSURE_HPP_
+
+#include <bta.h>
+#include <ros/ros.h>
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Closed loop integration time control.
+ *
+ * Every frame the amplitudes are binned into a histogram between 0 and the
+ * saturation amplitude. The integration time is scaled so that the given
+ * percentile of the valid pixels ends up at the target fraction of
+ * saturation, assuming amplitude grows linearly with integration time.
+ * Changes within the hysteresis band are ignored, every step is limited to
+ * a factor of 1 + maxStep, and the controller waits for the settling
+ * period after a change before looking again. The integration time never
+ * exceeds frameShare of the frame period, so the requested frame rate
+ * stays achievable.
+ */
+class AutoExposure
+{
+public:
+    struct Settings
+    {
+	Settings() :
+	    percentile(0.98), target(0.8), saturation(4095), hysteresis(0.1),
+	    maxStep(0.25), period(0.2), frameShare(0.2),
+	    minTime(100), maxTime(25000) {}
+
+	double percentile;  // of the valid pixels, 0..1
+	double target;      // fraction of saturation for the percentile
+	double saturation;  // amplitude at which pixels saturate
+	double hysteresis;  // relative error tolerated without a change
+	double maxStep;     // largest relative change per step
+	double period;      // s to wait after a change
+	double frameShare;  // largest share of the frame period integrating
+	uint32_t minTime, maxTime;  // us
+    };
+
+    explicit AutoExposure(const Settings &settings);
+
+    /**
+     *
+     * @brief Sets the integration time currently used by the camera, e.g.
+     * after it was changed by hand.
+     *
+     * @param [in] uint32_t integration time in us
+     *
+     */
+    void setIntegrationTime(uint32_t integrationTime);
+
+    /**
+     *
+     * @brief Sets the frame rate the integration time has to fit into.
+     *
+     * @param [in] double frame rate in Hz
+     *
+     */
+    void setFrameRate(double frameRate);
+
+    /**
+     *
+     * @brief Feeds the amplitudes of a frame. Returns true if the
+     * integration time should be changed to the returned value.
+     *
+     * @param [in] void * amplitudes
+     * @param [in] BTA_DataFormat UInt16 or Float32
+     * @param [in] size_t number of pixels
+     * @param [out] uint32_t new integration time in us
+     *
+     */
+    bool update(const void *amplitudes, BTA_DataFormat format, size_t count,
+		uint32_t &integrationTime);
+
+    /**
+     *
+     * @brief Adds amplitudes to a histogram of bins.size() bins of width
+     * 1/scale. Larger values go to the last bin.
+     *
+     */
+    static void histogram(const uint16_t *data, size_t count, float scale,
+			  std::vector<uint32_t> &bins);
+    static void histogram(const float *data, size_t count, float scale,
+			  std::vector<uint32_t> &bins);
+
+private:
+    uint32_t maxIntegrationTime() const;
+
+    Settings settings_;
+    boost::mutex mutex_;
+    uint32_t integrationTime_;
+    double frameRate_;
+    ros::WallTime lastChange_;
+    std::vector<uint32_t> bins_;
+};
+
+}
+
+#endif //_BTA_AUTO_EXPOSURE_HPP_
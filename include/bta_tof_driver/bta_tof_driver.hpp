@@ -44,9 +44,20 @@
 #define _BTA_TOF_DRIVER_HPP_
 
 #include <bta.h>
+#include <bta_tof_driver/frame_log.hpp>
+#include <bta_tof_driver/device_discovery.hpp>
+#include <bta_tof_driver/command_executor.hpp>
+#include <bta_tof_driver/auto_exposure.hpp>
+#include <bta_tof_driver/load_shedder.hpp>
+#include <bta_tof_driver/shm_ring.hpp>
+#include <bta_tof_driver/scan_extractor.hpp>
+#include <bta_tof_driver/frame_reducer.hpp>
+#include <bta_tof_driver/height_map.hpp>
+#include <bta_tof_driver/ground_segmenter.hpp>
 
 // ROS communication
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <image_transport/image_transport.h>
 #include <camera_info_manager/camera_info_manager.h>
 #include <sensor_msgs/Image.h>
@@ -54,6 +65,7 @@
 #include <sensor_msgs/SetCameraInfo.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <tf2_ros/static_transform_broadcaster.h>
 #include <geometry_msgs/TransformStamped.h>
@@ -65,17 +77,37 @@
 #include <pcl_ros/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/conversions.h>
+#include <pcl_conversions/pcl_conversions.h>
 
 // Standard libs
 #include <stdio.h>
 #include <time.h>
 #include <sstream>
 #include <string>
+#include <vector>
+#include <map>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 // Dynamic reconfigure
 #include <bta_tof_driver/bta_tof_driverConfig.h>
 #include <dynamic_reconfigure/server.h>
 
+// Services
+#include <bta_tof_driver/StartGrabbing.h>
+#include <bta_tof_driver/ReadRegisters.h>
+#include <bta_tof_driver/WriteRegisters.h>
+
+// Messages
+#include <bta_tof_driver/ShmSlot.h>
+#include <bta_tof_driver/HeightGrid.h>
+#include <bta_tof_driver/GroundPlane.h>
+#include <std_srvs/Trigger.h>
+
 //static ros::Publisher int_amp,int_dis,int_rgb;
 
 namespace bta_tof_driver {
@@ -87,6 +119,13 @@ class BtaRos
     typedef dynamic_reconfigure::Server<Config> ReconfigureServer;
 
 public:
+    typedef boost::function<void (const sensor_msgs::PointCloud2ConstPtr &)> CloudCallback;
+    typedef boost::function<void (const sensor_msgs::ImageConstPtr &)> ImageCallback;
+    typedef boost::function<bool ()> DemandCallback;
+    typedef boost::function<void (const geometry_msgs::TransformStamped &)> TransformCallback;
+    typedef pcl::PointCloud<pcl::PointXYZI> PclCloud;
+    typedef boost::function<BTA_Status (BTA_Handle)> HandleCommand;
+
 
     /**
      *
@@ -108,17 +147,80 @@ public:
 
     /**
      *
-     * @brief Initializes the device and parameters.
+     * @brief Initializes the device and parameters and runs the acquisition
+     * loop until shutdown.
      *
      */
     int initialize();
 
+    /**
+     *
+     * @brief Reads the configuration, connects to the device and advertises
+     * the topics. Called by initialize(); use it directly when somebody else
+     * drives acquisition.
+     *
+     */
+    int setup();
+
+    /**
+     *
+     * @brief Housekeeping between frames, e.g. rotating the grabbing file.
+     * Reconnection is done by the supervisor thread. Returns false on
+     * shutdown.
+     *
+     */
+    bool checkConnection();
+
+    /**
+     *
+     * @brief Returns the link state and the number and duration of the
+     * outages so far.
+     *
+     * @param [out] bool true if the device is connected
+     * @param [out] uint32_t number of outages
+     * @param [out] double duration of the last outage in seconds
+     * @param [out] double total downtime in seconds
+     *
+     */
+    void getLinkStats(bool &connected, uint32_t &outages,
+		      double &lastDowntime, double &totalDowntime);
+
+    /**
+     *
+     * @brief Returns the statistics of the control commands since the last
+     * call.
+     *
+     */
+    void getCommandStats(CommandExecutor::Stats &stats);
+
+    /**
+     *
+     * @brief Returns the load shedding counters since the last call.
+     *
+     * @param [out] LoadShedder::Stats
+     * @param [out] bool false if load shedding is off
+     *
+     */
+    void getShedStats(LoadShedder::Stats &stats, bool &enabled);
+
     /**
      *
      * @brief Helper for connect to the device.
      *
+     * @param [in] int number of attempts
+     *
+     */
+    int connectCamera(int attempts = 10);
+
+    /**
+     *
+     * @brief Connects to the device, locating it first through the address
+     * cache or a discovery round if discovery is enabled.
+     *
+     * @param [in] int number of attempts
+     *
      */
-    int connectCamera();
+    int connectDevice(int attempts = 10);
 
     /**
      *
@@ -135,6 +237,131 @@ public:
      */
     void publishData();
 
+    /**
+     *
+     * @brief Waits for the next frame. Returns false if no frame is needed
+     * or none arrived in time; otherwise the frame must be passed on to
+     * processFrame(). Never returns false in less than 10 ms, so callers
+     * can simply call it again.
+     *
+     * @param [out] BTA_Frame **
+     * @param [out] ros::Time host time at which the frame was received
+     *
+     */
+    bool acquireFrame(BTA_Frame **frame, ros::Time &stamp);
+
+    /**
+     *
+     * @brief Converts and publishes a frame and frees it.
+     *
+     * @param [in] BTA_Frame *
+     * @param [in] ros::Time stamp of the published messages
+     *
+     */
+    void processFrame(BTA_Frame *frame, const ros::Time &stamp);
+
+    /**
+     *
+     * @brief Hands every converted point cloud to an in-process consumer
+     * as well. The cloud is converted whenever the demand callback returns
+     * true, even without subscribers. Must be set before setup().
+     *
+     * @param [in] CloudCallback
+     * @param [in] DemandCallback
+     *
+     */
+    void setCloudCallback(const CloudCallback &callback, const DemandCallback &demand);
+
+    /**
+     *
+     * @brief Hands every distance image to an in-process consumer as well,
+     * while the demand callback returns true. Must be set before setup().
+     *
+     * @param [in] ImageCallback
+     * @param [in] DemandCallback
+     *
+     */
+    void setDistancesCallback(const ImageCallback &callback, const DemandCallback &demand);
+
+    /**
+     *
+     * @brief Hands the static transform of the cloud frame to the owner
+     * instead of broadcasting it. Several cameras in one process have to
+     * share one broadcaster: they share the latched /tf_static publication,
+     * which keeps only the last message. Must be set before setup().
+     *
+     * @param [in] TransformCallback
+     *
+     */
+    void setExtrinsicsCallback(const TransformCallback &callback);
+
+    /**
+     *
+     * @brief Subscriber status callback of all data topics. Owners of a
+     * demand callback call it too when their demand changes, otherwise a
+     * suspended acquisition only notices on its next poll.
+     *
+     */
+    void onSubscribers();
+
+    /**
+     *
+     * @brief True if any of the data topics has subscribers.
+     *
+     */
+    bool isSubscribed();
+
+    /**
+     *
+     * @brief Full name of the node (or camera) used for topics and parameters.
+     *
+     */
+    const std::string &getName() const { return nodeName_; }
+
+    /**
+     *
+     * @brief Starts grabbing raw frames to a .bltstream file in the given
+     * directory. A running grabbing process is stopped first.
+     *
+     * @param [in] std::string directory where the files are stored
+     *
+     */
+    bool startGrabbing(const std::string &path);
+
+    /**
+     *
+     * @brief Stops a running grabbing process.
+     *
+     */
+    void stopGrabbing();
+
+    /**
+     *
+     * @brief Reads count consecutive registers in one SDK call through the
+     * command executor. With useCache, registers known from earlier reads
+     * and writes are answered without a round trip. The cache is dropped
+     * on reconnect and whenever another setting is changed.
+     *
+     * @param [in] uint32_t address of the first register
+     * @param [in] uint32_t number of registers, at most 4096
+     * @param [out] std::vector<uint32_t> values, shorter if the device
+     * returned fewer
+     * @param [in] bool true to use the cache
+     * @param [out] bool true if the values came from the cache
+     *
+     */
+    BTA_Status readRegisters(uint32_t address, uint32_t count,
+			     std::vector<uint32_t> &values, bool useCache, bool *cached = NULL);
+
+    /**
+     *
+     * @brief Writes consecutive registers in one SDK call through the
+     * command executor and keeps the values in the register cache. At
+     * most 4096 at once.
+     *
+     */
+    BTA_Status writeRegisters(uint32_t address, const std::vector<uint32_t> &values);
+
     //void ampCb(const sensor_msgs::ImagePtr& amp);
 
     //void disCb(const sensor_msgs::ImagePtr& dis);
@@ -149,25 +376,216 @@ private:
     camera_info_manager::CameraInfoManager cim_tof_/*, *cim_rgb*/;
     image_transport::ImageTransport it_;
     image_transport::CameraPublisher pub_amp_, pub_dis_/*, pub_rgb*/;
-    tf2_ros::StaticTransformBroadcaster pub_tf;
+    boost::scoped_ptr<tf2_ros::StaticTransformBroadcaster> pub_tf;
+    TransformCallback extrinsicsCallback_;
     geometry_msgs::TransformStamped transformStamped;
     ros::Publisher pub_xyz_;
+    // Typed cloud, handed over as shared pointer within the manager
+    ros::Publisher pub_pcl_;
     //ros::Subscriber sub_amp_, sub_dis_;
     boost::shared_ptr<ReconfigureServer> reconfigure_server_;
     bool config_init_;
 
+    // Control plane: dynamic reconfigure and services are served from their
+    // own queue, and device commands run serialized on the executor
+    ros::NodeHandle nh_control_;
+    ros::CallbackQueue control_queue_;
+    boost::scoped_ptr<ros::AsyncSpinner> control_spinner_;
+    boost::scoped_ptr<CommandExecutor> commands_;
+
     boost::mutex connect_mutex_;
 
+    // Connection supervision. The handle is shared by everybody using it
+    // and exclusively locked by the supervisor while it is replaced.
+    boost::shared_mutex handle_mutex_;
+    boost::mutex link_mutex_;
+    boost::condition_variable link_cond_;
+    boost::scoped_ptr<boost::thread> supervisor_thread_;
+    bool handleOpen_, connected_;
+    volatile bool supervising_;
+    double keepAliveInterval_, linkPollInterval_;
+    double reconnectMinDelay_, reconnectMaxDelay_;
+    int frameTimeout_;
+    bool frameTimeoutAuto_;
+    ros::WallTime linkLostTime_;
+    uint32_t outages_;
+    double lastDowntime_, totalDowntime_;
+
     // Variables needed for config
     uint8_t udpDataIpAddr_[6], udpControlOutIpAddr_[6],
     udpControlInIpAddr_[6], tcpDeviceIpAddr_[6];
-    std::string uartPortName_, calibFileName_;
+    std::string uartPortName_, calibFileName_, pon_;
+
+    // Device discovery
+    bool discovery_;
+    double discoveryTimeout_;
+    std::string discoveryCacheFile_;
+
+    // Frames of the point cloud and of its static transform
+    std::string parentFrameId_, cloudFrameId_;
 
     sensor_msgs::PointCloud2Ptr _xyz;
+    PclCloud::Ptr _pcl;
+    CloudCallback cloudCallback_;
+    DemandCallback cloudDemand_;
+    ImageCallback distancesCallback_;
+    DemandCallback distancesDemand_;
+
+    // Raw frame grabbing
+    ros::ServiceServer srv_start_grabbing_, srv_stop_grabbing_;
+    ros::ServiceServer srv_read_registers_, srv_write_registers_;
+
+    // Register map as known from reads and writes, only touched on the
+    // command executor and by reconnect() with the handle locked
+    std::map<uint32_t, uint32_t> registerCache_;
+    std::string grabbingPath_, grabbingPrefix_, grabbingFile_;
+    double grabbingMaxFileSize_, grabbingMaxDuration_;
+    ros::WallTime grabbingStart_, grabbingLastCheck_;
+    int grabbingIndex_;
+    // Set on the command executor and by reconnect(), read by the
+    // acquisition thread
+    boost::atomic<bool> grabbing_;
+
+    // Subscriber driven acquisition: frame mode covering the active topics
+    // and suspension without subscribers
+    bool autoFrameMode_;
+    double idleFrameRate_;
+    // Frame rate last set by dynamic reconfigure
+    double frameRate_;
+    boost::mutex rate_mutex_;
+    // Only touched by the acquisition thread, reconnect() asks it to start
+    // over through reconnected_
+    BTA_FrameMode frameMode_;
+    boost::atomic<bool> suspended_, reconnected_;
+    boost::mutex demand_mutex_;
+    boost::condition_variable demand_cond_;
+
+    // Per output priorities and rates when the host falls behind
+    boost::scoped_ptr<LoadShedder> shedder_;
+    volatile bool frameQueued_;
+
+    // Shared memory rings for local consumers of clouds and distances
+    uint32_t shmSlots_;
+    uint64_t shmSlotSize_;
+    boost::scoped_ptr<ShmRingWriter> shm_cloud_, shm_dis_;
+    ros::Publisher pub_shm_cloud_, pub_shm_dis_;
+
+    // Region of interest and binning of all channels, if configured
+    boost::scoped_ptr<FrameReducer> reducer_;
+
+    // Height map of the cloud, if enabled
+    boost::scoped_ptr<HeightMap> heightMap_;
+    ros::Publisher pub_height_map_;
+
+    // Ground plane of the cloud, if enabled
+    boost::scoped_ptr<GroundSegmenter> groundSegmenter_;
+    ros::Publisher pub_ground_plane_, pub_ground_, pub_obstacles_;
+
+    // Virtual laser scan from a band of the distances
+    boost::scoped_ptr<ScanExtractor> scanExtractor_;
+    ros::Publisher pub_scan_;
+    ros::Time lastScanStamp_;
+
+    // Integration time control from the amplitudes, if enabled
+    boost::scoped_ptr<AutoExposure> autoExposure_;
+
+    // Compressed frame log for offline analysis
+    boost::scoped_ptr<FrameLogWriter> frameLog_;
 
     BTA_Handle handle_;
     BTA_Config config_;
 
+    /**
+     *
+     * @brief Broadcasts the static transform from the parent frame to the
+     * cloud frame, read from the "extrinsics" parameter
+     * [x, y, z, roll, pitch, yaw], or hands it to the extrinsics callback.
+     *
+     */
+    void publishExtrinsics();
+
+    /**
+     *
+     * @brief Smallest frame mode with the channels of the topics that have
+     * subscribers, or the configured one while recording or if
+     * "autoFrameMode" is off.
+     *
+     */
+    BTA_FrameMode requiredFrameMode();
+
+    /**
+     *
+     * @brief Switches the frame mode of the running connection, on the
+     * command executor.
+     *
+     */
+    void setFrameMode(BTA_FrameMode frameMode);
+
+    /**
+     *
+     * @brief Enters or leaves the suspended state, in which no frames are
+     * fetched and the camera runs at "idleFrameRate" (0 keeps the rate).
+     *
+     */
+    void setSuspended(bool suspended);
+    void applyIdleFrameRate();
+    void setCurrentFrameRate(double frameRate);
+    double getCurrentFrameRate();
+
+    /**
+     *
+     * @brief Converts the coordinates and amplitudes of a frame into points
+     * of the published layout (see shm_ring.hpp), adding them to the
+     * height map on the way if given. Returns false for unhandled data
+     * formats.
+     *
+     */
+    static bool writeCloud(uint8_t *data, size_t pointStep, const void *x, const void *y,
+			   const void *z, BTA_DataFormat dataFormat, float conv,
+			   const void *amplitudes, BTA_DataFormat amDataFormat, size_t count,
+			   HeightMap *map = NULL);
+    static bool writeCloud(pcl::PointXYZI *points, const void *x, const void *y,
+			   const void *z, BTA_DataFormat dataFormat, float conv,
+			   const void *amplitudes, BTA_DataFormat amDataFormat, size_t count);
+    static bool writeHeightMap(HeightMap &map, const void *x, const void *y, const void *z,
+			       BTA_DataFormat dataFormat, float conv, size_t count);
+    static bool writeXYZ(float *points, const void *x, const void *y, const void *z,
+			 BTA_DataFormat dataFormat, float conv, size_t count);
+
+    /**
+     *
+     * @brief Ground plane fit, publishing the plane and the split clouds
+     * that have subscribers.
+     *
+     */
+    bool groundWanted();
+    void segmentGround(const void *x, const void *y, const void *z, BTA_DataFormat dataFormat,
+		       float conv, uint16_t xRes, uint16_t yRes, uint32_t frameCounter,
+		       const ros::Time &stamp);
+
+    /**
+     *
+     * @brief Shared memory transport. The rings are created on first use,
+     * "shmSlots" enables them.
+     *
+     */
+    bool shmCloudWanted();
+    bool shmDistancesWanted();
+    uint8_t *beginShmSlot(boost::scoped_ptr<ShmRingWriter> &ring, const std::string &suffix,
+			  size_t size, uint32_t &slot);
+    void publishShmSlot(boost::scoped_ptr<ShmRingWriter> &ring, ros::Publisher &pub,
+			uint32_t slot, uint32_t frameCounter, const ros::Time &stamp,
+			const std::string &frameId, uint32_t width, uint32_t height,
+			uint32_t step, const std::string &encoding);
+
+    /**
+     *
+     * @brief True if the output may be converted for the current frame.
+     *
+     */
+    bool isAdmitted(LoadShedder::Output output);
+    void recordCost(LoadShedder::Output output, const ros::WallTime &start);
+
     /**
      *
      * @brief Callback for rqt_reconfigure. It is called any time we change a
@@ -179,6 +597,24 @@ private:
      */
     void callback(bta_tof_driver::bta_tof_driverConfig &config, uint32_t level);
 
+    /**
+     *
+     * @brief Runs a command on the device handle through the command
+     * executor and waits for it. Returns BTA_StatusTimeOut if it could not
+     * start within the latency budget.
+     *
+     * @param [in] std::string name of the command, a queued command of the
+     * same name is replaced
+     * @param [in] HandleCommand
+     * @param [in] bool true if the command writes settings that are
+     * registers too, which drops the register cache
+     *
+     */
+    BTA_Status runCommand(const std::string &name, const HandleCommand &command,
+			  bool aliasesRegisters = false);
+    void runOnHandle(const HandleCommand &command, BTA_Status *status,
+		     bool aliasesRegisters);
+
     /**
      *
      * @brief Reads configuration from the server parameters
@@ -186,6 +622,128 @@ private:
      */
     void parseConfig();
 
+    /**
+     *
+     * @brief Fills the connection part of the config from a discovered
+     * device.
+     *
+     */
+    void applyDiscoveredDevice(const DiscoveredDevice &device);
+
+    /**
+     *
+     * @brief Supervisor thread. Polls the link state, which the SDK keeps
+     * up to date with keep-alive messages, and reconnects with exponential
+     * backoff when it is lost.
+     *
+     */
+    void superviseConnection();
+
+    /**
+     *
+     * @brief Marks the link as lost and wakes up the supervisor.
+     *
+     */
+    void onLinkLost();
+
+    /**
+     *
+     * @brief Replaces the handle with a new connection and restores the
+     * settings of the previous one.
+     *
+     */
+    bool reconnect();
+
+    /**
+     *
+     * @brief Sets the keep-alive interval on the current handle.
+     *
+     */
+    void applyLinkSettings();
+
+    /**
+     *
+     * @brief Waits until the link is up, at most timeout seconds.
+     *
+     */
+    bool waitConnected(double timeout);
+
+    /**
+     *
+     * @brief Sleeps for timeout seconds or until a link event happens.
+     *
+     */
+    void waitLinkEvent(double timeout);
+
+    /**
+     *
+     * @brief Sets the BTAgetFrame timeout to a few frame periods unless it
+     * was configured explicitly.
+     *
+     */
+    void updateFrameTimeout(double frameRate);
+
+    /**
+     *
+     * @brief Service callbacks to start and stop raw frame grabbing.
+     *
+     */
+    bool startGrabbingCb(bta_tof_driver::StartGrabbing::Request &req,
+			 bta_tof_driver::StartGrabbing::Response &res);
+    bool stopGrabbingCb(std_srvs::Trigger::Request &req,
+			std_srvs::Trigger::Response &res);
+
+    /**
+     *
+     * @brief Opens the next .bltstream file of the current grabbing session.
+     *
+     */
+    bool openGrabbingFile();
+
+    /**
+     *
+     * @brief Grabbing commands, run on the command executor.
+     *
+     */
+    void rotateGrabbingFile();
+    void startGrabbingLocked(const std::string &path, bool *success);
+    void stopGrabbingLocked();
+
+    /**
+     *
+     * @brief Register access, run on the command executor.
+     *
+     */
+    void readRegistersLocked(uint32_t address, std::vector<uint32_t> *values,
+			     bool useCache, bool *cached, BTA_Status *status);
+    void writeRegistersLocked(uint32_t address, const std::vector<uint32_t> *values,
+			      BTA_Status *status);
+
+    /**
+     *
+     * @brief Service callbacks for block register access.
+     *
+     */
+    bool readRegistersCb(bta_tof_driver::ReadRegisters::Request &req,
+			 bta_tof_driver::ReadRegisters::Response &res);
+    bool writeRegistersCb(bta_tof_driver::WriteRegisters::Request &req,
+			  bta_tof_driver::WriteRegisters::Response &res);
+
+    /**
+     *
+     * @brief Rotates the grabbing file when it exceeds the configured size
+     * or duration. Called from the acquisition loop.
+     *
+     */
+    void checkGrabbingRotation();
+
+    /**
+     *
+     * @brief Opens the frame log if frameLogPath is configured.
+     *
+     */
+    void openFrameLog();
+
     /**
      *
      * @brief Returns the size of the data based in BTA_DataFormat
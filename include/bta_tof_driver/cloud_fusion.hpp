@@ -0,0 +1,165 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_CLOUD_FUSION_HPP_
+#define _BTA_CLOUD_FUSION_HPP_
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2_ros/transform_listener.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Merges the point clouds of several cameras of the same process
+ * into one cloud in a common frame.
+ *
+ * Clouds are grouped by time stamp: a group is complete once every source
+ * delivered a cloud no older than the fusion window relative to the newest
+ * one. Each cloud is transformed with the extrinsics looked up in TF and
+ * appended to the merged cloud, which is published on "point_cloud_xyz".
+ *
+ * All parameters are read from the given node handle:
+ *  frameId     target frame of the merged cloud (default "world")
+ *  window      maximum stamp difference within a group in s (default 0.02)
+ *  minClouds   smallest group published when a camera falls behind
+ *              (default all sources)
+ *  tfRefresh   period in s after which extrinsics are looked up again,
+ *              0 looks them up only once (default 1.0)
+ */
+class CloudFusion
+{
+public:
+    struct Stats
+    {
+	uint64_t fused, incomplete, dropped;
+	double latency, maxLatency, skew, maxSkew;
+    };
+
+    /**
+     *
+     * @brief Class constructor.
+     *
+     * param [in] ros::NodeHandle namespace of parameters and topic
+     * param [in] size_t number of sources
+     *
+     */
+    CloudFusion(ros::NodeHandle nh, size_t sources);
+
+    virtual ~CloudFusion();
+
+    /**
+     *
+     * @brief Hands over the newest cloud of a source. Called from the
+     * processing threads of the cameras.
+     *
+     * @param [in] size_t index of the source
+     * @param [in] sensor_msgs::PointCloud2ConstPtr
+     *
+     */
+    void addCloud(size_t source, const sensor_msgs::PointCloud2ConstPtr &cloud);
+
+    /**
+     *
+     * @brief True if somebody listens to the merged cloud.
+     *
+     */
+    bool isSubscribed() const;
+
+    /**
+     *
+     * @brief Returns the statistics since the last call and resets them.
+     * Latency and skew are averages over the fused groups.
+     *
+     */
+    void getStats(Stats &stats);
+
+    /**
+     *
+     * @brief Transforms the points of a cloud in place with a 3x4 row major
+     * matrix [R|t]. x, y and z must be consecutive float32 fields at offset
+     * xOffset. Points at the origin are invalid and become NaN.
+     *
+     */
+    static void transformPoints(uint8_t *data, size_t count, size_t pointStep,
+				size_t xOffset, const float *m);
+
+private:
+    bool lookupExtrinsics(size_t source, const std::string &frameId, float *m);
+    void fuse(std::vector<sensor_msgs::PointCloud2ConstPtr> &group);
+
+    ros::NodeHandle nh_;
+    ros::Publisher pub_;
+    tf2_ros::Buffer tfBuffer_;
+    tf2_ros::TransformListener tfListener_;
+
+    std::string frameId_;
+    double window_, tfRefresh_;
+    size_t minClouds_;
+
+    struct Extrinsics
+    {
+	std::string frameId;
+	ros::WallTime lookup;
+	float m[12];
+    };
+    std::vector<Extrinsics> extrinsics_;
+    boost::mutex tf_mutex_;
+
+    // Pending group, one slot per source
+    boost::mutex mutex_;
+    std::vector<sensor_msgs::PointCloud2ConstPtr> slots_;
+    Stats stats_;
+
+    // Merged clouds are reused once nobody holds them anymore
+    boost::mutex pool_mutex_;
+    sensor_msgs::PointCloud2Ptr merged_;
+};
+
+}
+
+#endif //_BTA_CLOUD_FUSION_HPP_
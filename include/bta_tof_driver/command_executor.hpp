@@ -0,0 +1,152 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_COMMAND_EXECUTOR_HPP_
+#define _BTA_COMMAND_EXECUTOR_HPP_
+
+#include <ros/ros.h>
+
+#include <deque>
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Runs device commands one at a time on a thread of its own, so
+ * control requests neither wait for the acquisition loop nor delay it.
+ *
+ * Every command has to start within the latency budget after it was
+ * queued, otherwise it expires without running. A queued command is
+ * replaced by a newer one of the same name, e.g. while a slider is dragged
+ * only the last value is sent. Commands that run longer than the budget are
+ * counted and reported.
+ */
+class CommandExecutor
+{
+public:
+    typedef boost::function<void ()> Command;
+
+    struct Stats
+    {
+	uint64_t executed, expired, superseded, overBudget;
+	double wait, maxWait, run, maxRun;
+    };
+
+    /**
+     *
+     * @brief Class constructor. Starts the executor thread.
+     *
+     * param [in] double latency budget in s
+     *
+     */
+    explicit CommandExecutor(double budget);
+
+    /**
+     *
+     * @brief Class destructor. Drops the queued commands and waits for the
+     * running one.
+     *
+     */
+    virtual ~CommandExecutor();
+
+    /**
+     *
+     * @brief Queues a command and waits until it ran. Returns false if it
+     * expired or was superseded instead; then it never runs.
+     *
+     * @param [in] std::string name, a newer command of the same name
+     * replaces this one while it is queued, unless it was posted
+     * @param [in] Command
+     *
+     */
+    bool execute(const std::string &name, const Command &command);
+
+    /**
+     *
+     * @brief Queues a command without waiting for it. It replaces a queued
+     * post of the same name but never an execute, it queues behind that.
+     *
+     */
+    void post(const std::string &name, const Command &command);
+
+    double getBudget() const { return budget_; }
+
+    /**
+     *
+     * @brief Returns the statistics since the last call and resets them.
+     * wait and run are averages over the executed commands.
+     *
+     */
+    void getStats(Stats &stats);
+
+private:
+    struct Job
+    {
+	std::string name;
+	Command command;
+	ros::WallTime queued;
+	bool waited, started, done, ran;
+    };
+    typedef boost::shared_ptr<Job> JobPtr;
+
+    JobPtr enqueue(const std::string &name, const Command &command, bool waited);
+    void finish(const JobPtr &job, bool ran);
+    void run();
+
+    double budget_;
+    boost::mutex mutex_;
+    boost::condition_variable queue_cond_, done_cond_;
+    std::deque<JobPtr> queue_;
+    bool running_;
+    Stats stats_;
+    boost::thread thread_;
+};
+
+}
+
+#endif //_BTA_COMMAND_EXECUTOR_HPP_
@@ -0,0 +1,136 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_DEVICE_DISCOVERY_HPP_
+#define _BTA_DEVICE_DISCOVERY_HPP_
+
+#include <bta.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Connection relevant part of a BTA_DeviceInfo, owning its buffers.
+ */
+struct DiscoveredDevice
+{
+    BTA_DeviceType deviceType;
+    std::string productOrderNumber;
+    uint32_t serialNumber;
+    std::vector<uint8_t> deviceIpAddr;
+    uint16_t tcpControlPort;
+    uint16_t tcpDataPort;
+    std::vector<uint8_t> udpDataIpAddr;
+    uint16_t udpDataPort;
+    uint16_t udpControlPort;
+    boost::posix_time::ptime found;
+
+    DiscoveredDevice();
+
+    /**
+     *
+     * @brief True if the device has the given serial number and product
+     * order number. 0 and an empty string match any device.
+     *
+     */
+    bool matches(uint32_t serial, const std::string &pon) const;
+};
+
+/**
+ * @brief Finds devices on the network with BTAstartDiscovery and keeps the
+ * last known address of a device in a cache file.
+ */
+class DeviceDiscovery
+{
+public:
+
+    /**
+     *
+     * @brief Runs a discovery round until a matching device answers or the
+     * timeout expires.
+     *
+     * @param [in] BTA_DeviceType device type to look for, 0 for any
+     * @param [in] uint32_t serial number, 0 for any
+     * @param [in] std::string product order number, empty for any
+     * @param [in] double timeout in seconds
+     * @param [out] DiscoveredDevice
+     *
+     */
+    static bool discover(BTA_DeviceType deviceType, uint32_t serial,
+			 const std::string &pon, double timeout,
+			 DiscoveredDevice *device);
+
+    /**
+     *
+     * @brief Reads the last known address of a device. Fails if the cache
+     * belongs to another device.
+     *
+     */
+    static bool loadCache(const std::string &fileName, uint32_t serial,
+			  const std::string &pon, DiscoveredDevice *device);
+
+    /**
+     *
+     * @brief Stores the address of a device for the next start.
+     *
+     */
+    static bool saveCache(const std::string &fileName, const DiscoveredDevice &device);
+
+private:
+    static void BTA_CALLCONV deviceFound(BTA_Handle handle, BTA_DeviceInfo *deviceInfo);
+    static void BTA_CALLCONV infoEvent(BTA_Handle handle, BTA_Status status, int8_t *msg);
+
+    static boost::mutex mutex_;
+    static boost::condition_variable found_cond_;
+    static std::vector<DiscoveredDevice> found_;
+};
+
+}
+
+#endif //_BTA_DEVICE_DISCOVERY_HPP_
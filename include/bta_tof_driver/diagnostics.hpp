@@ -0,0 +1,73 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+#ifndef _BTA_DIAGNOSTICS_HPP_
+#define _BTA_DIAGNOSTICS_HPP_
+
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include <diagnostic_msgs/KeyValue.h>
+
+#include <sstream>
+#include <string>
+
+namespace bta_tof_driver {
+
+/**
+ *
+ * @brief Appends a key value pair to a diagnostic status, the value
+ * formatted as by an ostream.
+ *
+ */
+template <typename T>
+inline void addValue(diagnostic_msgs::DiagnosticStatus &status,
+		     const std::string &key, T value)
+{
+    diagnostic_msgs::KeyValue kv;
+    std::ostringstream ss;
+    ss << value;
+    kv.key = key;
+    kv.value = ss.str();
+    status.values.push_back(kv);
+}
+
+}
+
+#endif //_BTA_DIAGNOSTICS_HPP_
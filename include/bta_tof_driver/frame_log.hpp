@@ -0,0 +1,217 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_FRAME_LOG_HPP_
+#define _BTA_FRAME_LOG_HPP_
+
+#include <bta.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Entry of the frame log index. The index file is a small header
+ * followed by fixed size entries, so entry i lives at a known offset and
+ * seeking to any frame is O(1).
+ */
+struct FrameLogIndexEntry
+{
+    uint32_t frameCounter;
+    uint32_t timeStamp;
+    uint32_t segment;
+    uint32_t compressedSize;
+    uint64_t offset;
+    uint32_t serializedSize;
+    uint32_t reserved;
+};
+
+struct FrameLogIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+};
+
+/**
+ * @brief Appends LZ4 compressed serialized frames to a segmented log.
+ *
+ * For a log named "base" the writer creates base.idx and the data segments
+ * base.00000.lz4, base.00001.lz4, ...
+ */
+class FrameLogWriter
+{
+public:
+
+    /**
+     *
+     * @brief Class constructor.
+     *
+     * param [in] std::string base name of the log files
+     * param [in] uint64_t maximum size of a data segment in bytes
+     *
+     */
+    FrameLogWriter(const std::string &base, uint64_t segmentSize);
+
+    /**
+     *
+     * @brief Class destructor. Flushes and closes all files.
+     *
+     */
+    virtual ~FrameLogWriter();
+
+    /**
+     *
+     * @brief Returns true if the index could be created and logging was
+     * not stopped by a failed index write.
+     *
+     */
+    bool isOpen() const { return index_ != NULL; }
+
+    /**
+     *
+     * @brief Serializes, compresses and appends a frame to the log. After a
+     * failed data write, later frames go to a new segment; after a failed
+     * index write, logging stops.
+     *
+     * @param [in] BTA_Frame * frame to append. Ownership stays with the caller.
+     *
+     */
+    bool append(BTA_Frame *frame);
+
+    /**
+     *
+     * @brief Number of frames written so far.
+     *
+     */
+    size_t size() const { return count_; }
+
+private:
+    bool openSegment(uint32_t segment);
+    void close();
+
+    std::string base_;
+    uint64_t segmentSize_;
+    FILE *index_, *data_;
+    uint32_t segment_;
+    uint64_t offset_;
+    size_t count_;
+    std::vector<uint8_t> serialized_, compressed_;
+};
+
+/**
+ * @brief Random access reader for logs written by FrameLogWriter.
+ *
+ * The index and the data segments are memory mapped, so frames can be
+ * decoded from several threads at the same time.
+ */
+class FrameLogReader
+{
+public:
+    typedef boost::function<void (size_t, BTA_Frame *)> FrameCallback;
+
+    FrameLogReader(const std::string &base);
+    virtual ~FrameLogReader();
+
+    bool isOpen() const { return entries_ != NULL; }
+
+    /**
+     *
+     * @brief Number of frames in the log.
+     *
+     */
+    size_t size() const { return count_; }
+
+    /**
+     *
+     * @brief Index entry of frame i.
+     *
+     */
+    const FrameLogIndexEntry &entry(size_t i) const { return entries_[i]; }
+
+    /**
+     *
+     * @brief Decodes frame i. The returned frame must be released with
+     * BTAfreeFrame. Safe to be called concurrently.
+     *
+     */
+    BTA_Status readFrame(size_t i, BTA_Frame **frame);
+
+    /**
+     *
+     * @brief Returns the position of the first frame with a time stamp not
+     * lower than timeStamp, or size() if there is none.
+     *
+     */
+    size_t findTimeStamp(uint32_t timeStamp) const;
+
+    /**
+     *
+     * @brief Decodes frames [begin, end) on threadCount threads. The callback
+     * is called from the worker threads and owns the frame it receives.
+     *
+     */
+    void decodeParallel(size_t begin, size_t end, unsigned threadCount,
+			FrameCallback callback);
+
+private:
+    const uint8_t *mapSegment(uint32_t segment, size_t *length);
+
+    std::string base_;
+    void *indexMap_;
+    size_t indexLength_;
+    const FrameLogIndexEntry *entries_;
+    size_t count_;
+
+    boost::mutex segments_mutex_;
+    std::vector<std::pair<void *, size_t> > segments_;
+};
+
+}
+
+#endif //_BTA_FRAME_LOG_HPP_
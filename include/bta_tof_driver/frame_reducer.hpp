@@ -0,0 +1,138 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_FRAME_REDUCER_HPP_
+#define _BTA_FRAME_REDUCER_HPP_
+
+#include <bta.h>
+#include <sensor_msgs/CameraInfo.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Region of interest and pixel binning applied to the channels of a
+ * frame before they are converted.
+ *
+ * The region is clipped to the image and shrunk to a multiple of the
+ * binning. Each output pixel is the mean or median of its binning x binning
+ * block. Distances and coordinates are invalid-aware: pixels without a
+ * measurement (0, or the origin for coordinates) are left out and a block
+ * without any valid pixel stays invalid. Amplitudes use every pixel.
+ */
+class FrameReducer
+{
+public:
+    enum Channel { Distances, Amplitudes, Channels };
+
+    struct Settings
+    {
+	Settings() :
+	    x(0), y(0), width(0), height(0), binning(1), median(false) {}
+
+	uint32_t x, y;           // offset of the region
+	uint32_t width, height;  // 0: up to the border
+	uint32_t binning;        // 1, 2 or 4
+	bool median;             // median instead of mean of a block
+    };
+
+    explicit FrameReducer(const Settings &settings);
+
+    /**
+     *
+     * @brief Reduces a distance or amplitude channel. Returns the reduced
+     * data, valid until the channel is reduced again, and updates the
+     * resolution. Unhandled formats are returned unchanged.
+     *
+     * @param [in] Channel
+     * @param [in] void * data
+     * @param [in] BTA_DataFormat UInt16 or Float32
+     * @param [in,out] uint16_t width
+     * @param [in,out] uint16_t height
+     *
+     */
+    void *reduce(Channel channel, void *data, BTA_DataFormat format,
+		 uint16_t &width, uint16_t &height);
+
+    /**
+     *
+     * @brief Reduces the coordinates, a point counting as invalid if it is
+     * the origin. Unhandled formats are left unchanged.
+     *
+     * @param [in,out] void * x, y and z coordinates
+     * @param [in] BTA_DataFormat SInt16 or Float32
+     * @param [in,out] uint16_t width
+     * @param [in,out] uint16_t height
+     *
+     */
+    void reducePoints(void *&x, void *&y, void *&z, BTA_DataFormat format,
+		      uint16_t &width, uint16_t &height);
+
+    /**
+     *
+     * @brief Describes the region and binning in the camera info of the
+     * full resolution.
+     *
+     * @param [in,out] CameraInfo
+     * @param [in] uint16_t full width
+     * @param [in] uint16_t full height
+     *
+     */
+    void adjust(sensor_msgs::CameraInfo &info, uint16_t width, uint16_t height) const;
+
+private:
+    struct Region
+    {
+	uint32_t x, y, width, height;
+    };
+    Region region(uint16_t width, uint16_t height) const;
+
+    Settings settings_;
+    std::vector<uint8_t> buffers_[Channels];
+    std::vector<uint8_t> points_[3];
+};
+
+}
+
+#endif //_BTA_FRAME_REDUCER_HPP_
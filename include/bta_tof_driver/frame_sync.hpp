@@ -0,0 +1,159 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_FRAME_SYNC_HPP_
+#define _BTA_FRAME_SYNC_HPP_
+
+#include <bta_tof_driver/gst_image.hpp>
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+
+#include <deque>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Pairs the distance images of a ToF camera with the closest 2D
+ * image of the same process.
+ *
+ * The newest 2D images are kept in a small ring indexed by time stamp. A
+ * distance image is paired as soon as a 2D image at least as new arrived,
+ * so the closest one is known, and only if the two are no further apart
+ * than the maximum offset. Pairs are published on "distances" and
+ * "image_raw" with the stamp of the distance image. The distances share
+ * the driver's message. The 2D image is copied once into a
+ * sensor_msgs::Image, or with gstImages shares the decoder's buffer, which
+ * only saves the copy for subscribers in other processes (see GstImage).
+ *
+ * All parameters are read from the given node handle:
+ *  ringSize    number of 2D images and of pending distance images kept
+ *              (default 8)
+ *  maxOffset   maximum stamp difference of a pair in s (default 0.05)
+ *  offset      added to the 2D stamps before pairing, e.g. to compensate
+ *              the encoding delay of the camera, in s (default 0.0)
+ *  gstImages   publish image_raw as GstImage (default false)
+ */
+class FrameSync
+{
+public:
+    typedef boost::function<void ()> DemandChangedCallback;
+
+    struct Stats
+    {
+	uint64_t paired, unmatched;
+	double offset, maxOffset;
+    };
+
+    /**
+     *
+     * @brief Class constructor.
+     *
+     * param [in] ros::NodeHandle namespace of parameters and topics
+     * param [in] DemandChangedCallback called when subscribers come or go
+     *
+     */
+    FrameSync(ros::NodeHandle nh, const DemandChangedCallback &demandChanged);
+
+    virtual ~FrameSync();
+
+    /**
+     *
+     * @brief Hands over a decoded 2D image. Called from the streaming
+     * thread of the 2D sensor.
+     *
+     * @param [in] GstImageConstPtr
+     *
+     */
+    void addImage(const GstImageConstPtr &image);
+
+    /**
+     *
+     * @brief Hands over a distance image. Called from the processing thread
+     * of the ToF camera.
+     *
+     * @param [in] sensor_msgs::ImageConstPtr
+     *
+     */
+    void addDistances(const sensor_msgs::ImageConstPtr &distances);
+
+    /**
+     *
+     * @brief True if somebody listens to the pairs.
+     *
+     */
+    bool isSubscribed() const;
+
+    /**
+     *
+     * @brief Returns the statistics since the last call and resets them.
+     * offset is the average absolute stamp difference of the pairs.
+     *
+     */
+    void getStats(Stats &stats);
+
+private:
+    typedef std::pair<sensor_msgs::ImageConstPtr, GstImageConstPtr> Pair;
+
+    void match(std::vector<Pair> &pairs);
+    void publish(const std::vector<Pair> &pairs);
+
+    ros::NodeHandle nh_;
+    ros::Publisher pub_distances_, pub_image_;
+
+    size_t ringSize_;
+    double maxOffset_, offset_;
+    bool gstImages_;
+
+    boost::mutex mutex_;
+    std::deque<GstImageConstPtr> images_;
+    std::deque<sensor_msgs::ImageConstPtr> pending_;
+    Stats stats_;
+};
+
+}
+
+#endif //_BTA_FRAME_SYNC_HPP_
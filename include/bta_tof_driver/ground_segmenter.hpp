@@ -0,0 +1,134 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_GROUND_SEGMENTER_HPP_
+#define _BTA_GROUND_SEGMENTER_HPP_
+
+#include <bta_tof_driver/GroundPlane.h>
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Ground plane fit of the organized cloud with RANSAC.
+ *
+ * The plane of the previous frame is scored first. If it still explains
+ * nearly as many points as before, the frame is done; otherwise planes
+ * through three points are sampled until the expected number of iterations
+ * for the best inlier share is reached, maxIterations ran, or the time
+ * budget is spent. Samples are triangles of pixels a fixed fraction of the
+ * image apart, so the points are spread out without searching. Planes
+ * tilted more than maxAngle against the up direction are rejected. The
+ * winner is refitted to its inliers by least squares. Scoring uses every
+ * stride-th pixel in both directions, the final split all points.
+ */
+class GroundSegmenter
+{
+public:
+    struct Settings
+    {
+	Settings() :
+	    distance(0.03), maxAngle(0.35), maxIterations(100), budget(0.005),
+	    stride(4) {}
+
+	double distance;        // largest distance of a ground point in m
+	double maxAngle;        // largest tilt against up in rad
+	int maxIterations;
+	double budget;          // s of sampling per frame
+	int stride;             // pixel step while scoring
+	std::vector<double> extrinsics;  // [x, y, z, roll, pitch, yaw] of the cloud
+					 // in a z-up frame, defines up
+    };
+
+    explicit GroundSegmenter(const Settings &settings);
+
+    /**
+     *
+     * @brief Buffer for the points of a frame in m, x, y and z of each
+     * pixel in a row.
+     *
+     */
+    float *points(uint16_t width, uint16_t height);
+
+    /**
+     *
+     * @brief Fits the plane to the points of the buffer.
+     *
+     * @param [out] GroundPlane coefficients and statistics, header left to
+     * the caller
+     *
+     */
+    void segment(GroundPlane &plane);
+
+    /**
+     *
+     * @brief Splits the valid points into ground and obstacles by their
+     * distance to the last plane. The clouds only get x, y and z.
+     *
+     */
+    void split(sensor_msgs::PointCloud2 &ground, sensor_msgs::PointCloud2 &obstacles) const;
+
+private:
+    bool valid(size_t i) const;
+    bool planeOf(size_t a, size_t b, size_t c, float plane[4]) const;
+    uint32_t score(const float plane[4]) const;
+    void refine(float plane[4]) const;
+    uint32_t random();
+
+    Settings settings_;
+    float up_[3];
+    float minCos_;
+    uint16_t width_, height_;
+    std::vector<float> points_;
+    float plane_[4];
+    bool hasPlane_;
+    uint32_t fitInliers_;
+    uint32_t random_;
+};
+
+}
+
+#endif //_BTA_GROUND_SEGMENTER_HPP_
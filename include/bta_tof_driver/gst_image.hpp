@@ -0,0 +1,222 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+#ifndef __GST_IMAGE_HPP__
+#define __GST_IMAGE_HPP__
+
+#include <gst/gst.h>
+
+#include <ros/ros.h>
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+#include <std_msgs/Header.h>
+#include <sensor_msgs/Image.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+
+namespace bta_tof_driver {
+
+	/**
+	 * @brief Image message backed by a GStreamer sample.
+	 *
+	 * It serializes exactly like sensor_msgs/Image, so subscribers see an
+	 * ordinary image, but the pixels stay in the mapped GstBuffer instead of
+	 * being copied into a vector. The sample is referenced until the last
+	 * holder of the message releases it.
+	 *
+	 * This only saves a copy for subscribers in other processes. roscpp
+	 * hands a published message to subscribers in the same process as is
+	 * only if they subscribed with the same type; a sensor_msgs::Image
+	 * subscriber gets it serialized and deserialized, two copies instead of
+	 * none. Those subscribers are better served by copy().
+	 */
+	class GstImage
+	{
+	public:
+		/**
+		 *
+		 * @brief Takes over the reference to sample and maps its buffer.
+		 *
+		 * @param [in] GstSample *
+		 *
+		 */
+		explicit GstImage(GstSample *sample) :
+			height(0),
+			width(0),
+			is_bigendian(0),
+			step(0),
+			data(NULL),
+			size(0),
+			sample_(sample),
+			buffer_(NULL)
+		{
+			if (!sample_)
+				return;
+			buffer_ = gst_sample_get_buffer(sample_);
+			if (buffer_ && gst_buffer_map(buffer_, &map_, GST_MAP_READ)) {
+				data = map_.data;
+				size = map_.size;
+			} else {
+				buffer_ = NULL;
+			}
+		}
+
+		virtual ~GstImage()
+		{
+			if (buffer_)
+				gst_buffer_unmap(buffer_, &map_);
+			if (sample_)
+				gst_sample_unref(sample_);
+		}
+
+		bool isMapped() const { return buffer_ != NULL; }
+
+		/**
+		 *
+		 * @brief New message on the same sample, e.g. to publish the
+		 * pixels again under another header. Nothing is copied.
+		 *
+		 */
+		boost::shared_ptr<GstImage> share() const
+		{
+			boost::shared_ptr<GstImage> image(
+				new GstImage(sample_ ? gst_sample_ref(sample_) : NULL));
+			image->header = header;
+			image->height = height;
+			image->width = width;
+			image->encoding = encoding;
+			image->is_bigendian = is_bigendian;
+			image->step = step;
+			image->size = std::min(image->size, size);
+			return image;
+		}
+
+		/**
+		 *
+		 * @brief The image as sensor_msgs::Image, copying the pixels once.
+		 *
+		 */
+		sensor_msgs::ImagePtr copy() const
+		{
+			sensor_msgs::ImagePtr image(new sensor_msgs::Image);
+			image->header = header;
+			image->height = height;
+			image->width = width;
+			image->encoding = encoding;
+			image->is_bigendian = is_bigendian;
+			image->step = step;
+			if (size > 0)
+				image->data.assign(data, data + size);
+			return image;
+		}
+
+		std_msgs::Header header;
+		uint32_t height;
+		uint32_t width;
+		std::string encoding;
+		uint8_t is_bigendian;
+		uint32_t step;
+		const uint8_t *data;
+		size_t size;
+
+	private:
+		GstImage(const GstImage &);
+		GstImage &operator=(const GstImage &);
+
+		GstSample *sample_;
+		GstBuffer *buffer_;
+		GstMapInfo map_;
+	};
+
+	typedef boost::shared_ptr<GstImage> GstImagePtr;
+	typedef boost::shared_ptr<GstImage const> GstImageConstPtr;
+}
+
+namespace ros {
+	namespace message_traits {
+		template<> struct IsMessage<bta_tof_driver::GstImage> : TrueType {};
+		template<> struct IsMessage<const bta_tof_driver::GstImage> : TrueType {};
+		template<> struct HasHeader<bta_tof_driver::GstImage> : TrueType {};
+
+		template<> struct MD5Sum<bta_tof_driver::GstImage> {
+			static const char *value() { return MD5Sum<sensor_msgs::Image>::value(); }
+			static const char *value(const bta_tof_driver::GstImage &) { return value(); }
+		};
+		template<> struct DataType<bta_tof_driver::GstImage> {
+			static const char *value() { return DataType<sensor_msgs::Image>::value(); }
+			static const char *value(const bta_tof_driver::GstImage &) { return value(); }
+		};
+		template<> struct Definition<bta_tof_driver::GstImage> {
+			static const char *value() { return Definition<sensor_msgs::Image>::value(); }
+			static const char *value(const bta_tof_driver::GstImage &) { return value(); }
+		};
+	}
+
+	namespace serialization {
+		// Write only: the layout of sensor_msgs/Image with the pixels taken
+		// straight from the mapped buffer
+		template<> struct Serializer<bta_tof_driver::GstImage> {
+			template<typename Stream>
+			inline static void write(Stream &stream, const bta_tof_driver::GstImage &m)
+			{
+				stream.next(m.header);
+				stream.next(m.height);
+				stream.next(m.width);
+				stream.next(m.encoding);
+				stream.next(m.is_bigendian);
+				stream.next(m.step);
+				stream.next((uint32_t)m.size);
+				if (m.size > 0)
+					memcpy(stream.advance((uint32_t)m.size), m.data, m.size);
+			}
+
+			inline static uint32_t serializedLength(const bta_tof_driver::GstImage &m)
+			{
+				return serializationLength(m.header) + 4 + 4 +
+					serializationLength(m.encoding) + 1 + 4 + 4 + (uint32_t)m.size;
+			}
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,135 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_HEIGHT_MAP_HPP_
+#define _BTA_HEIGHT_MAP_HPP_
+
+#include <bta_tof_driver/HeightGrid.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief 2.5D grid built from the points while the cloud is converted.
+ *
+ * Points are moved by the extrinsic transform into the grid frame and
+ * dropped into square cells of the x-y plane. Each cell keeps the highest
+ * and lowest z and the number of points next to each other, so a point
+ * updates one small contiguous cell. Points at the origin carry no
+ * measurement and are skipped.
+ */
+class HeightMap
+{
+public:
+    struct Settings
+    {
+	Settings() :
+	    cellSize(0.05), length(4.0), width(4.0), originX(0.0) {}
+
+	double cellSize;       // m
+	double length, width;  // extent along x and y in m
+	double originX;        // x of the near border, the grid is centered in y
+	std::vector<double> extrinsics;  // [x, y, z, roll, pitch, yaw] of the points
+	std::string frameId;
+    };
+
+    explicit HeightMap(const Settings &settings);
+
+    /**
+     *
+     * @brief Empties all cells, to be called before the points of a frame
+     * are added.
+     *
+     */
+    void clear();
+
+    /**
+     *
+     * @brief Adds a point in m of the cloud frame.
+     *
+     */
+    inline void add(const float p[3])
+    {
+	if (p[0] == 0 && p[1] == 0 && p[2] == 0)
+	    return;
+	float x = r_[0]*p[0] + r_[1]*p[1] + r_[2]*p[2] + t_[0];
+	float y = r_[3]*p[0] + r_[4]*p[1] + r_[5]*p[2] + t_[1];
+	float z = r_[6]*p[0] + r_[7]*p[1] + r_[8]*p[2] + t_[2];
+	float i = (x - originX_)*scale_, j = (y - originY_)*scale_;
+	// Also rejects NaN
+	if (!(i >= 0 && i < cellsX_ && j >= 0 && j < cellsY_))
+	    return;
+	Cell &cell = cells_[(uint32_t)j*cellsX_ + (uint32_t)i];
+	if (z > cell.max)
+	    cell.max = z;
+	if (z < cell.min)
+	    cell.min = z;
+	cell.count++;
+    }
+
+    /**
+     *
+     * @brief Copies the cells into a message, header stamp left to the
+     * caller.
+     *
+     */
+    void toMsg(HeightGrid &msg) const;
+
+private:
+    struct Cell
+    {
+	float max, min;
+	uint32_t count;
+    };
+
+    Settings settings_;
+    uint32_t cellsX_, cellsY_;
+    float originX_, originY_, scale_;
+    float r_[9], t_[3];
+    std::vector<Cell> cells_;
+};
+
+}
+
+#endif //_BTA_HEIGHT_MAP_HPP_
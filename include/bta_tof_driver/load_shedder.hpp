@@ -0,0 +1,143 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_LOAD_SHEDDER_HPP_
+#define _BTA_LOAD_SHEDDER_HPP_
+
+#include <ros/ros.h>
+
+#include <stdint.h>
+
+#include <boost/thread/mutex.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Decides per frame which outputs are converted and published when
+ * the host cannot keep up.
+ *
+ * Every output has a priority (0 is the most important and is never shed
+ * for load) and an optional maximum rate. Before a frame is converted, the
+ * wanted outputs are admitted in priority order as long as their measured
+ * conversion cost fits into the budget, loadLimit times the frame period.
+ * The budget is halved while the driver is behind: frames were lost
+ * between two processed ones, or the next frame was already waiting in the
+ * queue when it was fetched. The cost of a shed output decays, so it is
+ * tried again and measured anew once the host has room.
+ */
+class LoadShedder
+{
+public:
+    enum Output { Amplitudes, Distances, Cloud, Outputs };
+
+    struct Policy
+    {
+	Policy() : priority(0), maxRate(0) {}
+	int priority;
+	double maxRate;  // Hz, 0 is unlimited
+    };
+
+    struct Stats
+    {
+	uint64_t frames, behind;
+	uint64_t published[Outputs], rateLimited[Outputs], overload[Outputs];
+	double cost[Outputs];  // s, moving average
+    };
+
+    LoadShedder(const Policy *policies, double loadLimit);
+
+    /**
+     *
+     * @brief Plans the outputs of the next frame.
+     *
+     * @param [in] ros::Time stamp of the frame
+     * @param [in] uint32_t frame counter, gaps are lost frames
+     * @param [in] bool true if the frame was waiting in the queue
+     * @param [in] bool[Outputs] outputs that have consumers
+     *
+     */
+    void plan(const ros::Time &stamp, uint32_t frameCounter, bool queued,
+	      const bool *wanted);
+
+    /**
+     *
+     * @brief True if the output was admitted for the planned frame.
+     *
+     */
+    bool admitted(Output output) const { return admitted_[output]; }
+
+    /**
+     *
+     * @brief Records the time an admitted output took to convert and
+     * publish.
+     *
+     */
+    void record(Output output, double cost);
+
+    /**
+     *
+     * @brief Returns the counters since the last call and resets them.
+     *
+     */
+    void getStats(Stats &stats);
+
+    static const char *getName(Output output);
+
+private:
+    Policy policies_[Outputs];
+    Output order_[Outputs];
+    double loadLimit_;
+
+    double period_;
+    ros::Time lastStamp_, lastPublished_[Outputs];
+    uint32_t lastCounter_;
+    bool first_;
+    bool admitted_[Outputs];
+    double cost_[Outputs];  // moving averages in s
+
+    boost::mutex mutex_;
+    Stats stats_;
+};
+
+}
+
+#endif //_BTA_LOAD_SHEDDER_HPP_
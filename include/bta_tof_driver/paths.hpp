@@ -0,0 +1,84 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+#ifndef _BTA_PATHS_HPP_
+#define _BTA_PATHS_HPP_
+
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+
+namespace bta_tof_driver {
+
+/**
+ *
+ * @brief Replaces a leading '~' of a path by $HOME. Paths without
+ * it, or without HOME set, are returned unchanged.
+ *
+ */
+inline std::string expandHome(const std::string &path)
+{
+    if (path.empty() || path[0] != '~')
+	return path;
+    const char *home = getenv("HOME");
+    if (!home)
+	return path;
+    return std::string(home) + path.substr(1);
+}
+
+/**
+ *
+ * @brief Default path of a per node cache file under ~/.ros, the
+ * node name flattened into the file name.
+ *
+ */
+inline std::string rosCacheFile(const std::string &nodeName,
+				const std::string &extension)
+{
+    std::string name = nodeName;
+    std::replace(name.begin(), name.end(), '/', '_');
+    const char *home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.ros/bta_tof_driver" + name + extension;
+}
+
+}
+
+#endif //_BTA_PATHS_HPP_
@@ -0,0 +1,118 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_SCAN_EXTRACTOR_HPP_
+#define _BTA_SCAN_EXTRACTOR_HPP_
+
+#include <bta.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/LaserScan.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Virtual laser scan from a band of rows of the distance image.
+ *
+ * The distances are ranges along the pixel rays. Every pixel of the band is
+ * projected onto the horizontal plane of the camera with a factor computed
+ * once from the intrinsics, and each column keeps its closest valid range.
+ * Each evenly spaced beam of the scan then takes the closest range of the
+ * columns around its angle, angles counting counter-clockwise from the
+ * optical axis. Beams without a valid pixel are NaN. The scan frame must
+ * therefore have x along the optical axis and z up.
+ */
+class ScanExtractor
+{
+public:
+    struct Settings
+    {
+	Settings() :
+	    firstRow(-1), rows(8), rangeMin(0.1), rangeMax(10.0) {}
+
+	int firstRow;       // first row of the band, -1 centers it
+	int rows;           // height of the band
+	double rangeMin, rangeMax;  // m
+	std::string frameId;
+    };
+
+    explicit ScanExtractor(const Settings &settings);
+
+    /**
+     *
+     * @brief Reduces the band of the distance image to a scan. Returns
+     * false if the intrinsics are missing or the format is unhandled.
+     *
+     * @param [in] CameraInfo intrinsics, with region of interest and binning
+     * @param [in] void * distances
+     * @param [in] BTA_DataFormat UInt16 or Float32
+     * @param [in] float conversion of the distances to m
+     * @param [in] uint16_t image width
+     * @param [in] uint16_t image height
+     * @param [out] LaserScan scan, header stamp left to the caller
+     *
+     */
+    bool extract(const sensor_msgs::CameraInfo &info, const void *distances,
+		 BTA_DataFormat format, float conv, uint16_t width, uint16_t height,
+		 sensor_msgs::LaserScan &scan);
+
+private:
+    bool configure(const sensor_msgs::CameraInfo &info, uint16_t width, uint16_t height);
+
+    Settings settings_;
+    uint16_t width_, height_;
+    double fx_, fy_, cx_, cy_;
+    int firstRow_, rows_;
+    float angleMin_, angleIncrement_;
+    // Per pixel of the band: projection onto the horizontal plane
+    std::vector<float> scale_;
+    // Per beam: columns covering its angle
+    std::vector<uint32_t> firstColumn_, lastColumn_;
+    // Per column: closest range
+    std::vector<float> closest_;
+};
+
+}
+
+#endif //_BTA_SCAN_EXTRACTOR_HPP_
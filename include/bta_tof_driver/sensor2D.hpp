@@ -49,19 +49,28 @@
 #include <stdio.h>
 #include <glib-object.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <deque>
 #include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
 
 #include <ros/ros.h>
-#include <image_transport/image_transport.h>
 #include <camera_info_manager/camera_info_manager.h>
+#include <image_transport/image_transport.h>
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <sensor_msgs/SetCameraInfo.h>
 #include <sensor_msgs/image_encodings.h>
+#include <boost/function.hpp>
 #include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 //#include <opencv2/highgui/highgui.hpp>
 //#include <cv_bridge/cv_bridge.h>
 
+#include <bta_tof_driver/gst_image.hpp>
 
 #include <ros/console.h>
 
@@ -69,17 +78,93 @@ namespace bta_tof_driver {
 
 	class Sensor2D
 	{
+	public:
+		typedef boost::function<void (const GstImageConstPtr &)> ImageCallback;
+		typedef boost::function<bool ()> DemandCallback;
+
+	private:
+		// Pipeline branch fed by a request pad of the tee
+		struct Branch {
+			Branch() : tee(NULL), queue(NULL), teePad(NULL), waitKeyFrame(false) {}
+			GstElement *tee, *queue;
+			GstPad *teePad;
+			bool waitKeyFrame;
+		};
+
+		typedef GstFlowReturn (*NewSampleCallback)(GstAppSink *, gpointer);
+
+		// An image topic, published either as GstImage or through
+		// image_transport, see advertiseImage()
+		struct ImagePublisher {
+			ros::Publisher gst;
+			image_transport::Publisher it;
+			uint32_t getNumSubscribers() const {
+				return gst ? gst.getNumSubscribers() : it.getNumSubscribers();
+			}
+			void shutdown() {
+				gst.shutdown();
+				it.shutdown();
+			}
+		};
+
+		// Age of the published samples, from reception in the pipeline
+		struct LatencyStats {
+			LatencyStats() : frames(0), sum(0), max(0) {}
+			uint64_t frames;
+			double sum, max;
+		};
+
 		ros::NodeHandle nh_, nh_private_;
 		std::string nodeName_;
 		camera_info_manager::CameraInfoManager cim_rgb_;
 		image_transport::ImageTransport it_;
-		image_transport::CameraPublisher pub_rgb_;	
+		ImagePublisher pub_rgb_, pub_bgr_, pub_preview_;
+		ros::Publisher pub_rgb_info_, pub_h264_;
+		// Publish the images as GstImage instead of sensor_msgs::Image
+		bool gstImages_;
 	
 		std::string address_;
+
+		// Pipeline tuning, see readConfig()
+		bool lowLatency_, sync_, drop_, dropOnLatency_;
+		int decoderThreads_, skipFrame_, convertThreads_, maxBuffers_, latency_;
+		// Format of image_raw: BGR, I420 or NV12
+		std::string format_;
+		// Downscaled preview, 0 keeps the size or rate
+		std::string previewFormat_;
+		int previewWidth_, previewHeight_;
+		double previewRate_;
+
+		// Stream supervision
+		double reconnectMinDelay_, reconnectMaxDelay_, streamTimeout_;
+		std::string sdpCacheFile_;
+		bool sdpStale_;
+		volatile bool receiving_;
+		// Set by the streaming thread, guarded by stats_mutex_
+		ros::WallTime lastBuffer_;
+		uint32_t outages_;
+
+		boost::mutex stats_mutex_;
+		LatencyStats rawLatency_, h264Latency_, jitterDelay_, decodeLatency_;
+		// PTS and running time of the buffers entering the decoder
+		std::deque<std::pair<GstClockTime, GstClockTime> > decodeStart_;
+
+		// Header stamps: "receive" (arrival of the first packet), "rtcp"
+		// (sender capture time via RTCP SR) or "publish"
+		std::string stampSource_;
+		GstCaps *ntpCaps_;
+		ros::Publisher pub_stats_;
+		ros::WallTimer stats_timer_;
 	
 		GstElement *pipeline_;
-		GstElement *appsink;
+		GstElement *appsink, *h264sink, *bgrsink, *previewsink;
+		GstElement *tee_;
+		Branch rawBranch_, h264Branch_, imageBranch_, bgrBranch_, previewBranch_;
+		boost::mutex branch_mutex_;
 		GMainLoop *loop;
+
+		ImageCallback imageCallback_;
+		DemandCallback imageDemand_;
 	
 		//boost::thread* streaming;
 
@@ -92,7 +177,189 @@ namespace bta_tof_driver {
  	
 	void init();
 	void stop();
-	void getFrame();
+
+	/**
+	 *
+	 * @brief Hands every image_raw frame to an in-process consumer as well.
+	 * Frames are decoded whenever the demand callback returns true, even
+	 * without subscribers. Must be set before init().
+	 *
+	 * @param [in] ImageCallback
+	 * @param [in] DemandCallback
+	 *
+	 */
+	void setImageCallback(const ImageCallback &callback, const DemandCallback &demand);
+
+	/**
+	 *
+	 * @brief Links the decoding and the compressed branch to the tee while
+	 * they have subscribers and unlinks them otherwise. Called whenever a
+	 * subscriber comes or goes, and by the owner of the image callback
+	 * when its demand changes.
+	 *
+	 */
+	void updateBranches();
+
+ private:
+
+	/**
+	 *
+	 * @brief appsink callback, called on the streaming thread whenever a
+	 * decoded frame is ready.
+	 *
+	 */
+	static GstFlowReturn newSample(GstAppSink *sink, gpointer data);
+
+	/**
+	 *
+	 * @brief Reads the pipeline tuning parameters. "2dLowLatency" selects a
+	 * profile with a short jitter buffer, single threaded decoding and an
+	 * unsynchronized sink; every parameter given explicitly overrides it.
+	 *
+	 */
+	void readConfig();
+
+	/**
+	 *
+	 * @brief Time in seconds since the buffer was received by the
+	 * pipeline, or a negative value if it has no time stamp.
+	 *
+	 */
+	double bufferAge(GstBuffer *buffer);
+	GstClockTime runningTime();
+
+	/**
+	 *
+	 * @brief Header stamp of a buffer according to "2dStampSource". Falls
+	 * back to the arrival time if there is no sender report yet, and to the
+	 * current time if the buffer has no PTS.
+	 *
+	 */
+	ros::Time getStamp(GstBuffer *buffer);
+
+	/**
+	 *
+	 * @brief Time in seconds the buffer spent in decoding and conversion,
+	 * or a negative value if its entry to the decoder was not seen.
+	 *
+	 */
+	double decodeTime(GstBuffer *buffer);
+	static GstPadProbeReturn decodeProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+	void addLatency(LatencyStats &stats, double age);
+
+	/**
+	 *
+	 * @brief Publishes the latency statistics and the pipeline settings on
+	 * /diagnostics.
+	 *
+	 */
+	void publishStats(const ros::WallTimerEvent &event);
+
+	/**
+	 *
+	 * @brief Runs the stream until shutdown. Sleeps on the pipeline bus and
+	 * restarts the pipeline with exponential backoff after an error, the
+	 * end of the stream or when no data arrived for "2dStreamTimeout"
+	 * seconds.
+	 *
+	 */
+	void supervise();
+
+	/**
+	 *
+	 * @brief Sets the pipeline to PLAYING, fetching the SDP first if it is
+	 * not cached yet or the cached one did not work.
+	 *
+	 */
+	bool startStream();
+
+	/**
+	 *
+	 * @brief Downloads the SDP into the cache file.
+	 *
+	 */
+	bool fetchSdp();
+
+	/**
+	 *
+	 * @brief Seconds since the last buffer reached the alive probe.
+	 *
+	 */
+	double timeSinceBuffer();
+
+	static GstPadProbeReturn aliveProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+
+	static void elementAdded(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data);
+
+	/**
+	 *
+	 * @brief True if rtpjitterbuffer can attach the RTCP capture time to
+	 * the buffers, which older GStreamer releases (e.g. 1.16) cannot.
+	 *
+	 */
+	static bool jitterBufferHasNtpMeta();
+
+	/**
+	 *
+	 * @brief appsink callback of the BGR branch that exists next to a YUV
+	 * image_raw.
+	 *
+	 */
+	static GstFlowReturn newBgrSample(GstAppSink *sink, gpointer data);
+
+	/**
+	 *
+	 * @brief appsink callback of the downscaled preview branch.
+	 *
+	 */
+	static GstFlowReturn newPreviewSample(GstAppSink *sink, gpointer data);
+
+	/**
+	 *
+	 * @brief Advertises an image topic below sensor2d. As GstImage, remote
+	 * subscribers get the pixels straight from the decoder's buffer, but
+	 * subscribers in the same process have the message serialized and
+	 * deserialized, two copies per frame. Through image_transport, the
+	 * pixels are copied once into a sensor_msgs::Image that nodelets in the
+	 * same process share, and the compressed transports are offered.
+	 *
+	 */
+	void advertiseImage(ImagePublisher &pub, const std::string &topic);
+
+	/**
+	 *
+	 * @brief Publishes a sample and hands it to the image callback. Takes
+	 * over the sample reference.
+	 *
+	 * @param [in] GstSample *
+	 * @param [in] ImagePublisher publisher of the image
+	 * @param [in] bool true to publish the camera info as well
+	 *
+	 */
+	void publishSample(GstSample *sample, ImagePublisher &pub, bool info);
+
+	GstElement *makeAppSink(NewSampleCallback callback);
+	static GstElement *makeRawFilter(const std::string &format);
+
+	/**
+	 *
+	 * @brief ROS encoding of a video format. I420 and NV12 have no constant
+	 * in sensor_msgs and are published as "i420" and "nv12".
+	 *
+	 */
+	static std::string getEncoding(const GstVideoInfo &info);
+
+	/**
+	 *
+	 * @brief appsink callback of the compressed branch.
+	 *
+	 */
+	static GstFlowReturn newH264Sample(GstAppSink *sink, gpointer data);
+
+	void setBranchLinked(Branch &branch, bool linked);
+
+	static GstPadProbeReturn keyFrameProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+	static GstPadProbeReturn unlinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data);
 
 	};
 }
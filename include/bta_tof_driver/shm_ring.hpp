@@ -0,0 +1,214 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#ifndef _BTA_SHM_RING_HPP_
+#define _BTA_SHM_RING_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Header of a slot of the shared memory ring. The payload follows
+ * right after it.
+ *
+ * sequence works as a seqlock: it is odd while the driver writes the slot
+ * and the even value announced in the ShmSlot message once the slot is
+ * complete. A reader can use the slot as long as the sequence did not
+ * change.
+ */
+struct ShmSlotHeader
+{
+    uint64_t sequence;
+    uint32_t size;
+    uint32_t frameCounter;
+    uint32_t stampSec, stampNsec;
+    uint32_t width, height;
+    // Row step of images, point step of clouds, in bytes
+    uint32_t step;
+    uint32_t reserved;
+    // Image encoding, or "xyz32f_i16u" for clouds: float32 x, y, z in m
+    // at offsets 0, 4, 8 and uint16 intensity at 12
+    char encoding[32];
+};
+
+struct ShmRingHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t slots;
+    uint64_t slotSize;
+};
+
+/**
+ * @brief Creates a POSIX shared memory ring and writes frames into its
+ * slots, one after the other.
+ */
+class ShmRingWriter
+{
+public:
+    /**
+     *
+     * @brief Creates (or replaces) the shared memory object.
+     *
+     * param [in] std::string name, e.g. "/bta_tof_driver_cloud"
+     * param [in] uint32_t number of slots
+     * param [in] uint64_t payload size of a slot in bytes
+     *
+     */
+    ShmRingWriter(const std::string &name, uint32_t slots, uint64_t slotSize);
+
+    /**
+     *
+     * @brief Class destructor. Marks the ring closed for readers still
+     * mapping it, unmaps and unlinks it.
+     *
+     */
+    virtual ~ShmRingWriter();
+
+    bool isOpen() const { return base_ != NULL; }
+    const std::string &getName() const { return name_; }
+    uint64_t getSlotSize() const { return slotSize_; }
+
+    /**
+     *
+     * @brief Starts writing the next slot and returns its payload, or NULL
+     * if size does not fit. Readers see the slot as invalid until commit().
+     *
+     * @param [in] uint64_t payload size
+     * @param [out] uint32_t index of the slot
+     *
+     */
+    uint8_t *begin(uint64_t size, uint32_t &slot);
+
+    /**
+     *
+     * @brief Completes the slot. The size and the sequence number are set
+     * here, the other fields of header are copied.
+     *
+     * @param [in] uint32_t index of the slot
+     * @param [in] ShmSlotHeader
+     *
+     * @return sequence number to announce
+     *
+     */
+    uint64_t commit(uint32_t slot, const ShmSlotHeader &header);
+
+private:
+    ShmSlotHeader *getSlot(uint32_t slot);
+
+    std::string name_;
+    uint32_t slots_;
+    uint64_t slotSize_;
+    size_t mapSize_;
+    uint8_t *base_;
+    uint32_t next_;
+    uint64_t pendingSize_;
+};
+
+/**
+ * @brief Maps a ring created by ShmRingWriter read only, for the consumers.
+ */
+class ShmRingReader
+{
+public:
+    ShmRingReader();
+    virtual ~ShmRingReader();
+
+    /**
+     *
+     * @brief Maps the ring. Remaps if the name now refers to another
+     * object, e.g. after the driver restarted, or the writer closed the
+     * mapped one.
+     *
+     */
+    bool open(const std::string &name);
+    void close();
+    bool isOpen() const { return base_ != NULL; }
+
+    /**
+     *
+     * @brief Returns the payload of a slot if it still holds the announced
+     * sequence, or NULL. The pointer refers to shared memory the driver
+     * will overwrite eventually; check isValid() after using it.
+     *
+     * @param [in] uint32_t index of the slot
+     * @param [in] uint64_t sequence from the ShmSlot message
+     * @param [out] ShmSlotHeader copy of the slot header
+     *
+     */
+    const uint8_t *get(uint32_t slot, uint64_t sequence, ShmSlotHeader &header) const;
+
+    /**
+     *
+     * @brief True if the slot was not overwritten since get().
+     *
+     */
+    bool isValid(uint32_t slot, uint64_t sequence) const;
+
+    /**
+     *
+     * @brief Copies the payload of a slot. Returns false if it was
+     * overwritten meanwhile.
+     *
+     */
+    bool copy(uint32_t slot, uint64_t sequence, ShmSlotHeader &header,
+	      std::vector<uint8_t> &data) const;
+
+private:
+    const ShmSlotHeader *getSlot(uint32_t slot) const;
+
+    std::string name_;
+    size_t mapSize_;
+    const uint8_t *base_;
+    uint32_t slots_;
+    uint64_t slotSize_;
+    // Identity of the mapped object
+    uint64_t device_, inode_;
+};
+
+}
+
+#endif //_BTA_SHM_RING_HPP_
@@ -0,0 +1,197 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/auto_exposure.hpp>
+
+#include <math.h>
+#include <algorithm>
+
+namespace bta_tof_driver {
+
+static const size_t histogramBins = 256;
+
+AutoExposure::AutoExposure(const Settings &settings) :
+    settings_(settings),
+    integrationTime_(settings.minTime),
+    frameRate_(0),
+    bins_(histogramBins)
+{
+}
+
+void AutoExposure::setIntegrationTime(uint32_t integrationTime)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    integrationTime_ = integrationTime;
+    lastChange_ = ros::WallTime::now();
+}
+
+void AutoExposure::setFrameRate(double frameRate)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    frameRate_ = frameRate;
+}
+
+uint32_t AutoExposure::maxIntegrationTime() const
+{
+    uint32_t maxTime = settings_.maxTime;
+    if (frameRate_ > 0)
+	maxTime = std::min(maxTime, (uint32_t)(settings_.frameShare*1e6/frameRate_));
+    return std::max(maxTime, settings_.minTime);
+}
+
+void AutoExposure::histogram(const uint16_t *data, size_t count, float scale,
+			     std::vector<uint32_t> &bins)
+{
+    // Four partial histograms, so consecutive pixels in the same bin do not
+    // wait for each other's increment, and a branch free bin index the
+    // compiler can vectorize
+    const uint32_t last = bins.size() - 1;
+    std::vector<uint32_t> partial(4*bins.size(), 0);
+    uint32_t *h0 = &partial[0], *h1 = h0 + bins.size(),
+	*h2 = h1 + bins.size(), *h3 = h2 + bins.size();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+	uint32_t b0 = std::min((uint32_t)(data[i]*scale), last);
+	uint32_t b1 = std::min((uint32_t)(data[i+1]*scale), last);
+	uint32_t b2 = std::min((uint32_t)(data[i+2]*scale), last);
+	uint32_t b3 = std::min((uint32_t)(data[i+3]*scale), last);
+	h0[b0]++;
+	h1[b1]++;
+	h2[b2]++;
+	h3[b3]++;
+    }
+    for (; i < count; i++)
+	h0[std::min((uint32_t)(data[i]*scale), last)]++;
+    for (size_t b = 0; b < bins.size(); b++)
+	bins[b] += h0[b] + h1[b] + h2[b] + h3[b];
+}
+
+void AutoExposure::histogram(const float *data, size_t count, float scale,
+			     std::vector<uint32_t> &bins)
+{
+    const float last = bins.size() - 1;
+    std::vector<uint32_t> partial(4*bins.size(), 0);
+    uint32_t *h0 = &partial[0], *h1 = h0 + bins.size(),
+	*h2 = h1 + bins.size(), *h3 = h2 + bins.size();
+    size_t i = 0;
+    // Negative and NaN amplitudes count as 0
+    for (; i + 4 <= count; i += 4) {
+	h0[(uint32_t)std::max(std::min(data[i]*scale, last), 0.f)]++;
+	h1[(uint32_t)std::max(std::min(data[i+1]*scale, last), 0.f)]++;
+	h2[(uint32_t)std::max(std::min(data[i+2]*scale, last), 0.f)]++;
+	h3[(uint32_t)std::max(std::min(data[i+3]*scale, last), 0.f)]++;
+    }
+    for (; i < count; i++)
+	h0[(uint32_t)std::max(std::min(data[i]*scale, last), 0.f)]++;
+    for (size_t b = 0; b < bins.size(); b++)
+	bins[b] += h0[b] + h1[b] + h2[b] + h3[b];
+}
+
+/**
+ *
+ * @brief Pixels without any signal, negative and NaN amplitudes included.
+ *
+ */
+template <typename T>
+static uint64_t countInvalid(const T *data, size_t count)
+{
+    uint64_t invalid = 0;
+    for (size_t i = 0; i < count; i++)
+	invalid += !(data[i] > 0);
+    return invalid;
+}
+
+bool AutoExposure::update(const void *amplitudes, BTA_DataFormat format, size_t count,
+			  uint32_t &integrationTime)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    ros::WallTime now = ros::WallTime::now();
+    // Frames taken before the last change are still on their way
+    if ((now - lastChange_).toSec() < settings_.period || count == 0)
+	return false;
+
+    std::fill(bins_.begin(), bins_.end(), 0);
+    float scale = bins_.size() / settings_.saturation;
+    uint64_t invalid;
+    if (format == BTA_DataFormatUInt16) {
+	histogram(static_cast<const uint16_t *>(amplitudes), count, scale, bins_);
+	invalid = countInvalid(static_cast<const uint16_t *>(amplitudes), count);
+    } else if (format == BTA_DataFormatFloat32) {
+	histogram(static_cast<const float *>(amplitudes), count, scale, bins_);
+	invalid = countInvalid(static_cast<const float *>(amplitudes), count);
+    } else {
+	return false;
+    }
+
+    // Pixels without signal are invalid and say nothing about exposure.
+    // Weak but non-zero ones stay in the lowest bin, so an under-exposed
+    // scene still raises the integration time.
+    bins_[0] -= invalid;
+    uint64_t valid = count - invalid;
+    if (valid == 0)
+	return false;
+    uint64_t rank = (uint64_t)ceil(settings_.percentile*valid);
+    uint64_t sum = 0;
+    size_t bin = 0;
+    for (; bin < bins_.size() - 1; bin++) {
+	sum += bins_[bin];
+	if (sum >= rank)
+	    break;
+    }
+    double level = (bin + 0.5) / bins_.size();
+
+    double ratio = settings_.target / level;
+    uint32_t next = integrationTime_;
+    if (fabs(ratio - 1) > settings_.hysteresis) {
+	ratio = std::max(std::min(ratio, 1 + settings_.maxStep), 1 / (1 + settings_.maxStep));
+	next = (uint32_t)(integrationTime_*ratio);
+    }
+    // Also pulls the integration time back after the frame rate was raised
+    next = std::max(std::min(next, maxIntegrationTime()), settings_.minTime);
+    if (next == integrationTime_)
+	return false;
+    integrationTime_ = integrationTime = next;
+    lastChange_ = now;
+    return true;
+}
+
+}
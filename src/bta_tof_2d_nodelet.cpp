@@ -0,0 +1,148 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/bta_tof_driver.hpp>
+#include <bta_tof_driver/sensor2D.hpp>
+#include <bta_tof_driver/frame_sync.hpp>
+#include <bta_tof_driver/diagnostics.hpp>
+#include <nodelet/nodelet.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Runs the ToF camera and the 2D sensor of one device in one nodelet
+ * and pairs their frames in process (see FrameSync). The parameters are
+ * the ones of BtaRosNodelet and Sensor2DNodelet; the pairs and the pairing
+ * parameters live in the "sync" sub-namespace.
+ */
+class BtaRos2DNodelet : public nodelet::Nodelet {
+
+public:
+    BtaRos2DNodelet() :
+	nodelet::Nodelet()
+    {
+    };
+
+    virtual ~BtaRos2DNodelet()
+    {
+	if (tof_thread_)
+	    tof_thread_->join();
+	if (sensor2d_thread_)
+	    sensor2d_thread_->join();
+	// The appsink keeps calling into sync_ until ~Sensor2D stops the
+	// pipeline, so the sources have to go first
+	sensor2d_.reset();
+	tof_.reset();
+    };
+
+private:
+    virtual void onInit()
+    {
+	NODELET_WARN_STREAM("Initializing nodelet..." << getName());
+	ros::NodeHandle &nh = getNodeHandle();
+	ros::NodeHandle &nh_private = getPrivateNodeHandle();
+
+	tof_.reset(new BtaRos(nh, nh_private, getName()));
+	sensor2d_.reset(new Sensor2D(nh, nh_private, getName()));
+	sync_.reset(new FrameSync(ros::NodeHandle(nh_private, "sync"),
+				  boost::bind(&BtaRos2DNodelet::onSyncSubscribers, this)));
+
+	tof_->setDistancesCallback(boost::bind(&FrameSync::addDistances, sync_.get(), _1),
+				   boost::bind(&FrameSync::isSubscribed, sync_.get()));
+	sensor2d_->setImageCallback(boost::bind(&FrameSync::addImage, sync_.get(), _1),
+				    boost::bind(&FrameSync::isSubscribed, sync_.get()));
+
+	double statsPeriod;
+	nh_private.param("syncStatsPeriod", statsPeriod, 1.0);
+	pub_stats_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+	stats_timer_ = nh.createWallTimer(ros::WallDuration(statsPeriod),
+					  &BtaRos2DNodelet::publishStats, this);
+
+	tof_thread_.reset(new boost::thread(boost::bind(&BtaRos::initialize, tof_.get())));
+	sensor2d_thread_.reset(new boost::thread(boost::bind(&Sensor2D::init, sensor2d_.get())));
+    };
+
+    // Both sides feed the pairs, both have to know when they are wanted
+    void onSyncSubscribers()
+    {
+	sensor2d_->updateBranches();
+	tof_->onSubscribers();
+    }
+
+    void publishStats(const ros::WallTimerEvent &event)
+    {
+	if (pub_stats_.getNumSubscribers() == 0)
+	    return;
+	FrameSync::Stats syncStats;
+	sync_->getStats(syncStats);
+	diagnostic_msgs::DiagnosticArrayPtr stats(new diagnostic_msgs::DiagnosticArray);
+	stats->header.stamp = ros::Time::now();
+	diagnostic_msgs::DiagnosticStatus status;
+	status.name = getName() + "/sync";
+	status.level = diagnostic_msgs::DiagnosticStatus::OK;
+	addValue(status, "paired", syncStats.paired);
+	addValue(status, "unmatched", syncStats.unmatched);
+	addValue(status, "offset [ms]", 1000.*syncStats.offset);
+	addValue(status, "max offset [ms]", 1000.*syncStats.maxOffset);
+	if (syncStats.unmatched > 0)
+	    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+	stats->status.push_back(status);
+	pub_stats_.publish(stats);
+    }
+
+    // Declared first to outlive both sources feeding it
+    boost::scoped_ptr<FrameSync> sync_;
+    boost::scoped_ptr<BtaRos> tof_;
+    boost::scoped_ptr<Sensor2D> sensor2d_;
+    boost::scoped_ptr<boost::thread> tof_thread_, sensor2d_thread_;
+
+    ros::Publisher pub_stats_;
+    ros::WallTimer stats_timer_;
+};
+
+}
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(bta_tof_driver::BtaRos2DNodelet, nodelet::Nodelet);
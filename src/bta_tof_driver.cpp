@@ -41,10 +41,19 @@
  */
 
 #include <bta_tof_driver/bta_tof_driver.hpp>
+#include <bta_tof_driver/paths.hpp>
+
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <algorithm>
 
 namespace bta_tof_driver 
 {
 
+// Largest register block read or written in one call, far more than any
+// register map but small enough to allocate for any request
+static const uint32_t maxRegisterBlock = 4096;
+
 BtaRos::BtaRos(ros::NodeHandle nh_camera,
 	       ros::NodeHandle nh_private,
 	       std::string nodeName) :
@@ -54,7 +63,32 @@ BtaRos::BtaRos(ros::NodeHandle nh_camera,
     cim_tof_(nh_camera),
     nodeName_(nodeName),
     config_init_(false),
-    _xyz (new sensor_msgs::PointCloud2)
+    discovery_(false),
+    discoveryTimeout_(3.0),
+    handleOpen_(false),
+    connected_(false),
+    supervising_(false),
+    frameTimeout_(3000),
+    frameTimeoutAuto_(true),
+    outages_(0),
+    lastDowntime_(0),
+    totalDowntime_(0),
+    parentFrameId_("world"),
+    _xyz (new sensor_msgs::PointCloud2),
+    grabbingPrefix_("bta"),
+    grabbingMaxFileSize_(0),
+    grabbingMaxDuration_(0),
+    grabbingIndex_(0),
+    grabbing_(false),
+    autoFrameMode_(true),
+    idleFrameRate_(1.0),
+    frameRate_(0),
+    frameMode_(BTA_FrameModeCurrentConfig),
+    suspended_(false),
+    reconnected_(false),
+    frameQueued_(false),
+    shmSlots_(0),
+    shmSlotSize_(0)
 {
     //Set log to debug to test capturing. Remove if not needed.
     /*
@@ -63,19 +97,6 @@ BtaRos::BtaRos(ros::NodeHandle nh_camera,
     {
 	ros::console::notifyLoggerLevelsChanged();
     }*/
-    transformStamped.header.stamp = ros::Time::now();
-    transformStamped.header.frame_id = "world";
-    transformStamped.child_frame_id = "cloud";
-    transformStamped.transform.translation.x = 0.0;
-    transformStamped.transform.translation.y = 0.0;
-    transformStamped.transform.translation.z = 0.0;
-    tf::Quaternion q;
-    q.setRPY(0, 0, 0);
-    transformStamped.transform.rotation.x = q.x();
-    transformStamped.transform.rotation.y = q.y();
-    transformStamped.transform.rotation.z = q.z();
-    transformStamped.transform.rotation.w = q.w();
-    pub_tf.sendTransform(transformStamped);
 }
 
 BtaRos::~BtaRos()
@@ -87,10 +108,26 @@ BtaRos::~BtaRos()
 void BtaRos::close()
 {
     ROS_DEBUG("Close called");
-    if (BTAisConnected(handle_)) {
+    if (control_spinner_) {
+	control_spinner_->stop();
+	control_spinner_.reset();
+    }
+    commands_.reset();
+    if (supervisor_thread_) {
+	{
+	    boost::mutex::scoped_lock lock(link_mutex_);
+	    supervising_ = false;
+	}
+	link_cond_.notify_all();
+	supervisor_thread_->join();
+	supervisor_thread_.reset();
+    }
+    stopGrabbing();
+    if (handleOpen_) {
 	ROS_DEBUG("Closing..");
 	BTA_Status status;
 	status = BTAclose(&handle_);
+	handleOpen_ = false;
 	printf("done: %d \n", status);
     }
 
@@ -98,8 +135,164 @@ void BtaRos::close()
 }
 
 
+BTA_Status BtaRos::runCommand(const std::string &name, const HandleCommand &command,
+			      bool aliasesRegisters)
+{
+    BTA_Status status = BTA_StatusTimeOut;
+    if (!commands_->execute(name, boost::bind(&BtaRos::runOnHandle, this, command, &status,
+					      aliasesRegisters)))
+	ROS_WARN_STREAM("Command " << name << " did not start within " <<
+			commands_->getBudget() << " s");
+    return status;
+}
+
+void BtaRos::runOnHandle(const HandleCommand &command, BTA_Status *status,
+			 bool aliasesRegisters)
+{
+    boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+    // Settings are registers themselves, the cached map may be stale
+    if (aliasesRegisters)
+	registerCache_.clear();
+    BTA_Status result = command(handle_);
+    if (status)
+	*status = result;
+}
+
+BTA_Status BtaRos::readRegisters(uint32_t address, uint32_t count,
+				 std::vector<uint32_t> &values, bool useCache, bool *cached)
+{
+    BTA_Status status = BTA_StatusTimeOut;
+    if (cached)
+	*cached = false;
+    if (count == 0 || count > maxRegisterBlock) {
+	values.clear();
+	return BTA_StatusInvalidParameter;
+    }
+    values.resize(count);
+    if (!commands_->execute("registers", boost::bind(&BtaRos::readRegistersLocked, this,
+						     address, &values, useCache, cached, &status)))
+	ROS_WARN_STREAM("Reading registers did not start within " <<
+			commands_->getBudget() << " s");
+    return status;
+}
+
+BTA_Status BtaRos::writeRegisters(uint32_t address, const std::vector<uint32_t> &values)
+{
+    BTA_Status status = BTA_StatusTimeOut;
+    if (values.empty() || values.size() > maxRegisterBlock)
+	return BTA_StatusInvalidParameter;
+    if (!commands_->execute("registers", boost::bind(&BtaRos::writeRegistersLocked, this,
+						     address, &values, &status)))
+	ROS_WARN_STREAM("Writing registers did not start within " <<
+			commands_->getBudget() << " s");
+    return status;
+}
+
+void BtaRos::readRegistersLocked(uint32_t address, std::vector<uint32_t> *values,
+				 bool useCache, bool *cached, BTA_Status *status)
+{
+    boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+    uint32_t count = values->size();
+    if (useCache) {
+	size_t i = 0;
+	for (; i < count; i++) {
+	    std::map<uint32_t, uint32_t>::const_iterator it = registerCache_.find(address + i);
+	    if (it == registerCache_.end())
+		break;
+	    (*values)[i] = it->second;
+	}
+	if (i == count) {
+	    if (cached)
+		*cached = true;
+	    *status = BTA_StatusOk;
+	    return;
+	}
+    }
+
+    // The whole block in one round trip
+    uint32_t registerCount = count;
+    *status = BTAreadRegister(handle_, address, &(*values)[0], &registerCount);
+    if (*status != BTA_StatusOk)
+	return;
+    values->resize(std::min(registerCount, count));
+    for (size_t i = 0; i < values->size(); i++)
+	registerCache_[address + i] = (*values)[i];
+}
+
+void BtaRos::writeRegistersLocked(uint32_t address, const std::vector<uint32_t> *values,
+				  BTA_Status *status)
+{
+    boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+    std::vector<uint32_t> data(*values);
+    uint32_t registerCount = data.size();
+    *status = BTAwriteRegister(handle_, address, &data[0], &registerCount);
+    // Write through; after a failure the device state is unknown
+    for (size_t i = 0; i < data.size(); i++) {
+	if (*status == BTA_StatusOk && i < registerCount)
+	    registerCache_[address + i] = data[i];
+	else
+	    registerCache_.erase(address + i);
+    }
+}
+
+bool BtaRos::readRegistersCb(bta_tof_driver::ReadRegisters::Request &req,
+			     bta_tof_driver::ReadRegisters::Response &res)
+{
+    if (req.count == 0 || req.count > maxRegisterBlock) {
+	std::ostringstream ss;
+	ss << "count has to be 1 to " << maxRegisterBlock;
+	res.success = false;
+	res.message = ss.str();
+	return true;
+    }
+    bool cached = false;
+    BTA_Status status = readRegisters(req.address, req.count, res.values,
+				      !req.bypass_cache, &cached);
+    res.success = status == BTA_StatusOk;
+    res.cached = cached;
+    if (!res.success) {
+	std::ostringstream ss;
+	ss << "Could not read " << req.count << " registers at 0x" << std::hex <<
+	    req.address << std::dec << ". Status: " << status;
+	res.message = ss.str();
+	res.values.clear();
+    }
+    return true;
+}
+
+bool BtaRos::writeRegistersCb(bta_tof_driver::WriteRegisters::Request &req,
+			      bta_tof_driver::WriteRegisters::Response &res)
+{
+    if (req.values.empty() || req.values.size() > maxRegisterBlock) {
+	std::ostringstream ss;
+	ss << "1 to " << maxRegisterBlock << " values can be written at once";
+	res.success = false;
+	res.message = ss.str();
+	return true;
+    }
+    BTA_Status status = writeRegisters(req.address, req.values);
+    res.success = status == BTA_StatusOk;
+    if (!res.success) {
+	std::ostringstream ss;
+	ss << "Could not write " << req.values.size() << " registers at 0x" <<
+	    std::hex << req.address << std::dec << ". Status: " << status;
+	res.message = ss.str();
+    }
+    return true;
+}
+
+void BtaRos::getCommandStats(CommandExecutor::Stats &stats)
+{
+    if (commands_)
+	commands_->getStats(stats);
+    else
+	memset(&stats, 0, sizeof(stats));
+}
+
 void BtaRos::callback(bta_tof_driver::bta_tof_driverConfig &config_, uint32_t level)
 {
+    // Runs on the control queue; everything touching the device goes
+    // through the command executor
     BTA_Status status;
     // Check the configuretion parameters with those given in the initialization
     int it;
@@ -109,25 +302,27 @@ void BtaRos::callback(bta_tof_driver::bta_tof_driverConfig &config_, uint32_t le
     if (!config_init_) {
 	if (nh_private_.getParam(nodeName_+"/integrationTime",it)) {
 	    usValue = (uint32_t)it;
-	    status = BTAsetIntegrationTime(handle_, usValue);
+	    status = runCommand("integrationTime", boost::bind(&BTAsetIntegrationTime, _1, usValue), true);
 	    if (status != BTA_StatusOk)
 		ROS_WARN_STREAM("Error setting IntegrationTime:: " << status << "---------------");
 	} else {
-	    status = BTAgetIntegrationTime(handle_, &usValue);
+	    status = runCommand("getIntegrationTime", boost::bind(&BTAgetIntegrationTime, _1, &usValue));
 	    if (status != BTA_StatusOk)
 		ROS_WARN_STREAM("Error reading IntegrationTime: " << status << "---------------");
 	    else
 		nh_private_.setParam(nodeName_+"/integrationTime", (int)usValue);
 	}
 	nh_private_.getParam(nodeName_+"/integrationTime",config_.Integration_Time);
+	if (autoExposure_)
+	    autoExposure_->setIntegrationTime(config_.Integration_Time);
 
 	if (nh_private_.getParam(nodeName_+"/frameRate",fr)) {
-	    status = BTAsetFrameRate(handle_, fr);
+	    status = runCommand("frameRate", boost::bind(&BTAsetFrameRate, _1, (float)fr), true);
 	    if (status != BTA_StatusOk)
 		ROS_WARN_STREAM("Error setting FrameRate: " << status << "---------------");
 	} else {
 	    float fr_f;
-	    status = BTAgetFrameRate(handle_, &fr_f);
+	    status = runCommand("getFrameRate", boost::bind(&BTAgetFrameRate, _1, &fr_f));
 	    fr = fr_f;
 	    if (status != BTA_StatusOk)
 		ROS_WARN_STREAM("Error reading FrameRate: " << status << "---------------");
@@ -135,6 +330,10 @@ void BtaRos::callback(bta_tof_driver::bta_tof_driverConfig &config_, uint32_t le
 		nh_private_.setParam(nodeName_+"/frameRate", fr);
 	}
 	nh_private_.getParam(nodeName_+"/frameRate",config_.Frame_rate);
+	setCurrentFrameRate(config_.Frame_rate);
+	updateFrameTimeout(config_.Frame_rate);
+	if (autoExposure_)
+	    autoExposure_->setFrameRate(config_.Frame_rate);
 	config_init_ = true;
 	return;
     }
@@ -143,28 +342,40 @@ void BtaRos::callback(bta_tof_driver::bta_tof_driverConfig &config_, uint32_t le
     nh_private_.getParam(nodeName_+"/integrationTime",it);
     if(it != config_.Integration_Time) {
 	usValue = (uint32_t)config_.Integration_Time;
-	status = BTAsetIntegrationTime(handle_, usValue);
+	status = runCommand("integrationTime", boost::bind(&BTAsetIntegrationTime, _1, usValue), true);
 	if (status != BTA_StatusOk)
 	    ROS_WARN_STREAM("Error setting IntegrationTime: " << status << "---------------");
-	else
+	else {
 	    nh_private_.setParam(nodeName_+"/integrationTime", config_.Integration_Time);
+	    // A manual change is the new starting point of the controller
+	    if (autoExposure_)
+		autoExposure_->setIntegrationTime(config_.Integration_Time);
+	}
     }
 
     nh_private_.getParam(nodeName_+"/frameRate",fr);
     if(fr != config_.Frame_rate) {
 	usValue = (uint32_t)config_.Frame_rate;
-	status = BTAsetFrameRate(handle_, usValue);
+	status = runCommand("frameRate", boost::bind(&BTAsetFrameRate, _1, (float)usValue), true);
 	if (status != BTA_StatusOk)
 	    ROS_WARN_STREAM("Error setting FrameRate: " << status << "---------------");
-	else
+	else {
 	    nh_private_.setParam(nodeName_+"/frameRate", config_.Frame_rate);
+	    setCurrentFrameRate(config_.Frame_rate);
+	    updateFrameTimeout(config_.Frame_rate);
+	    if (autoExposure_)
+		autoExposure_->setFrameRate(config_.Frame_rate);
+	}
     }
 
     if(config_.Read_reg) {
 	try {
 	    std::stringstream ss;
 	    it = strtoul(config_.Reg_addr.c_str(), NULL, 0);
-	    status = BTAreadRegister(handle_, it, &usValue, 0);
+	    std::vector<uint32_t> values;
+	    status = readRegisters(it, 1, values, false);
+	    if (status == BTA_StatusOk && !values.empty())
+		usValue = values[0];
 	    if (status != BTA_StatusOk) {
 		ROS_WARN_STREAM("Could not read reg: " << config_.Reg_addr << ". Status: " << status);
 	    }
@@ -182,7 +393,7 @@ void BtaRos::callback(bta_tof_driver::bta_tof_driverConfig &config_, uint32_t le
 	it = strtoul(config_.Reg_addr.c_str(), NULL, 0);
 	usValue = strtoul(config_.Reg_val.c_str(), NULL, 0);
 
-	status = BTAwriteRegister(handle_, it, &usValue, 0);
+	status = writeRegisters(it, std::vector<uint32_t>(1, usValue));
 	if (status != BTA_StatusOk) {
 	    ROS_WARN_STREAM("Could not write reg: " <<
 			    config_.Reg_addr <<
@@ -191,16 +402,172 @@ void BtaRos::callback(bta_tof_driver::bta_tof_driverConfig &config_, uint32_t le
 			    ". Status: " << status);
 	}
 	ROS_INFO_STREAM("Written register: " << config_.Reg_addr << ". Value: " << config_.Reg_val);
-	BTAgetIntegrationTime(handle_, &usValue);
+	runCommand("getIntegrationTime", boost::bind(&BTAgetIntegrationTime, _1, &usValue));
 	config_.Integration_Time = usValue;
-	BTAsetFrameRate(handle_, fr);
+	runCommand("frameRate", boost::bind(&BTAsetFrameRate, _1, (float)fr), true);
 	config_.Frame_rate = fr;
+	setCurrentFrameRate(fr);
 	config_.Write_reg = false;
 
     }
 
 }
 
+bool BtaRos::startGrabbing(const std::string &path)
+{
+    if (grabbing_)
+	stopGrabbing();
+
+    grabbingPath_ = expandHome(path);
+    if (grabbingPath_.empty())
+	grabbingPath_ = ".";
+    mkdir(grabbingPath_.c_str(), 0755);
+
+    grabbingIndex_ = 0;
+    grabbingStart_ = ros::WallTime::now();
+    if (!openGrabbingFile())
+	return false;
+    grabbing_ = true;
+    return true;
+}
+
+void BtaRos::stopGrabbing()
+{
+    if (!grabbing_)
+	return;
+    BTA_Status status = BTAstartGrabbing(handle_, NULL);
+    if (status != BTA_StatusOk)
+	ROS_WARN_STREAM("Error stopping grabbing: " << status);
+    ROS_INFO_STREAM("Stopped grabbing to " << grabbingFile_);
+    grabbing_ = false;
+}
+
+bool BtaRos::openGrabbingFile()
+{
+    char timeStr[32];
+    time_t now = time(NULL);
+    strftime(timeStr, sizeof(timeStr), "%Y%m%d-%H%M%S", localtime(&now));
+    std::ostringstream filename;
+    filename << grabbingPath_ << "/" << grabbingPrefix_ << "_" << timeStr
+	     << "_" << grabbingIndex_++ << ".bltstream";
+    grabbingFile_ = filename.str();
+
+    BTA_GrabbingConfig grabbingConfig;
+    BTAinitGrabbingConfig(&grabbingConfig);
+    grabbingConfig.filename = (uint8_t *)grabbingFile_.c_str();
+    BTA_Status status = BTAstartGrabbing(handle_, &grabbingConfig);
+    if (status != BTA_StatusOk) {
+	ROS_WARN_STREAM("Error starting grabbing to " << grabbingFile_ << ": " << status);
+	return false;
+    }
+    grabbingLastCheck_ = ros::WallTime::now();
+    ROS_INFO_STREAM("Grabbing frames to " << grabbingFile_);
+    return true;
+}
+
+void BtaRos::checkGrabbingRotation()
+{
+    if (!grabbing_)
+	return;
+    // stat() is cheap but there is no need to do it every frame
+    ros::WallTime now = ros::WallTime::now();
+    if ((now - grabbingLastCheck_).toSec() < 1.0)
+	return;
+    grabbingLastCheck_ = now;
+
+    bool rotate = false;
+    if (grabbingMaxDuration_ > 0 &&
+	    (now - grabbingStart_).toSec() >= grabbingMaxDuration_)
+	rotate = true;
+    struct stat st;
+    if (grabbingMaxFileSize_ > 0 && stat(grabbingFile_.c_str(), &st) == 0 &&
+	    st.st_size >= grabbingMaxFileSize_*1024*1024)
+	rotate = true;
+    if (!rotate)
+	return;
+
+    // Opening the next file talks to the device, do not hold up frames
+    grabbingStart_ = now;
+    commands_->post("rotateGrabbing", boost::bind(&BtaRos::rotateGrabbingFile, this));
+}
+
+void BtaRos::rotateGrabbingFile()
+{
+    boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+    if (!grabbing_)
+	return;
+    BTAstartGrabbing(handle_, NULL);
+    if (!openGrabbingFile())
+	grabbing_ = false;
+}
+
+bool BtaRos::startGrabbingCb(bta_tof_driver::StartGrabbing::Request &req,
+			     bta_tof_driver::StartGrabbing::Response &res)
+{
+    std::string path = req.path;
+    if (path.empty())
+	nh_private_.param<std::string>(nodeName_+"/grabbingPath", path, "~/.ros");
+    nh_private_.param<std::string>(nodeName_+"/grabbingPrefix", grabbingPrefix_, "bta");
+    nh_private_.param(nodeName_+"/grabbingMaxFileSize", grabbingMaxFileSize_, 0.0);
+    nh_private_.param(nodeName_+"/grabbingMaxDuration", grabbingMaxDuration_, 0.0);
+    if (req.max_file_size > 0)
+	grabbingMaxFileSize_ = req.max_file_size;
+    if (req.max_duration > 0)
+	grabbingMaxDuration_ = req.max_duration;
+
+    bool success = false;
+    commands_->execute("grabbing", boost::bind(&BtaRos::startGrabbingLocked, this, path, &success));
+    res.success = success;
+    res.filename = grabbingFile_;
+    res.message = res.success ? "Grabbing started" : "Could not start grabbing";
+    return true;
+}
+
+bool BtaRos::stopGrabbingCb(std_srvs::Trigger::Request &req,
+			    std_srvs::Trigger::Response &res)
+{
+    res.success = grabbing_;
+    res.message = grabbing_ ? grabbingFile_ : "Not grabbing";
+    if (!commands_->execute("grabbing", boost::bind(&BtaRos::stopGrabbingLocked, this)))
+	res.success = false;
+    return true;
+}
+
+void BtaRos::startGrabbingLocked(const std::string &path, bool *success)
+{
+    boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+    *success = startGrabbing(path);
+}
+
+void BtaRos::stopGrabbingLocked()
+{
+    boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+    stopGrabbing();
+}
+
+void BtaRos::openFrameLog()
+{
+    std::string path;
+    if (!nh_private_.getParam(nodeName_+"/frameLogPath", path) || path.empty())
+	return;
+    path = expandHome(path);
+    double segmentSize;
+    nh_private_.param(nodeName_+"/frameLogSegmentSize", segmentSize, 256.0);
+
+    char timeStr[32];
+    time_t now = time(NULL);
+    strftime(timeStr, sizeof(timeStr), "%Y%m%d-%H%M%S", localtime(&now));
+    std::string base = path + "_" + timeStr;
+
+    frameLog_.reset(new FrameLogWriter(base, (uint64_t)(segmentSize*1024*1024)));
+    if (!frameLog_->isOpen()) {
+	ROS_WARN_STREAM("Could not open frame log " << base);
+	frameLog_.reset();
+	return;
+    }
+    ROS_INFO_STREAM("Logging frames to " << base << ".idx");
+}
+
 size_t BtaRos::getDataSize(BTA_DataFormat dataFormat) {
     switch (dataFormat) {
     case BTA_DataFormatUInt16:
@@ -246,19 +613,408 @@ float BtaRos::getUnit2Meters(BTA_Unit unit) {
 
 void BtaRos::publishData()
 {
-    if (
-	    (pub_amp_.getNumSubscribers() == 0) &&
-	    (pub_dis_.getNumSubscribers() == 0) &&
-	    (pub_xyz_.getNumSubscribers() == 0)
-	    ) return;
+    BTA_Frame *frame;
+    ros::Time stamp;
+    if (acquireFrame(&frame, stamp))
+	processFrame(frame, stamp);
+}
+
+bool BtaRos::isSubscribed()
+{
+    return
+	    (pub_amp_.getNumSubscribers() > 0) ||
+	    (pub_dis_.getNumSubscribers() > 0) ||
+	    (pub_xyz_.getNumSubscribers() > 0) ||
+	    (pub_pcl_.getNumSubscribers() > 0) ||
+	    (pub_scan_.getNumSubscribers() > 0) ||
+	    (pub_height_map_.getNumSubscribers() > 0) ||
+	    groundWanted() ||
+	    (cloudDemand_ && cloudDemand_()) ||
+	    (distancesDemand_ && distancesDemand_()) ||
+	    shmCloudWanted() || shmDistancesWanted();
+}
 
-    BTA_Status status;
+BTA_FrameMode BtaRos::requiredFrameMode()
+{
+    if (!autoFrameMode_)
+	return config_.frameMode;
+    // Recordings get whatever was configured. Once the mode was switched,
+    // "current config" would keep the last one: fall back to the cloud
+    BTA_FrameMode configured = config_.frameMode != BTA_FrameModeCurrentConfig ?
+	config_.frameMode : BTA_FrameModeXYZAmp;
+    if (grabbing_ || frameLog_)
+	return configured;
+    bool distances = pub_dis_.getNumSubscribers() > 0 || pub_scan_.getNumSubscribers() > 0 ||
+	(distancesDemand_ && distancesDemand_()) || shmDistancesWanted();
+    bool cloud = pub_xyz_.getNumSubscribers() > 0 || pub_pcl_.getNumSubscribers() > 0 ||
+	pub_height_map_.getNumSubscribers() > 0 || groundWanted() ||
+	(cloudDemand_ && cloudDemand_()) || shmCloudWanted();
+    // No mode has distances and coordinates
+    if (distances && cloud)
+	return configured;
+    // The amplitudes are the intensity of the cloud
+    if (cloud)
+	return BTA_FrameModeXYZAmp;
+    return BTA_FrameModeDistAmp;
+}
 
-    BTA_Frame *frame;
-    status = BTAgetFrame(handle_, &frame, 3000);
+void BtaRos::setFrameMode(BTA_FrameMode frameMode)
+{
+    boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+    BTA_Status status = BTAsetFrameMode(handle_, frameMode);
+    if (status != BTA_StatusOk)
+	ROS_WARN_STREAM("Error setting frame mode " << frameMode << ": " << status);
+    else
+	ROS_INFO_STREAM("Frame mode " << frameMode);
+}
+
+void BtaRos::setSuspended(bool suspended)
+{
+    if (suspended == suspended_)
+	return;
+    suspended_ = suspended;
+    ROS_INFO_STREAM(suspended ? "No subscribers, acquisition suspended" :
+		    "Acquisition resumed");
+    if (idleFrameRate_ <= 0)
+	return;
+    // The rate is looked up when the command runs, so toggling back and
+    // forth ends in the right one
+    commands_->post("idleFrameRate", boost::bind(&BtaRos::applyIdleFrameRate, this));
+}
+
+void BtaRos::applyIdleFrameRate()
+{
+    // A slow stream while nobody listens saves link bandwidth and heat;
+    // leaving it restores the rate set by dynamic reconfigure
+    double fr = suspended_ ? idleFrameRate_ : getCurrentFrameRate();
+    if (fr <= 0)
+	return;
+    runOnHandle(boost::bind(&BTAsetFrameRate, _1, (float)fr), NULL, true);
+}
+
+void BtaRos::setCurrentFrameRate(double frameRate)
+{
+    boost::mutex::scoped_lock lock(rate_mutex_);
+    frameRate_ = frameRate;
+}
+
+double BtaRos::getCurrentFrameRate()
+{
+    boost::mutex::scoped_lock lock(rate_mutex_);
+    return frameRate_;
+}
+
+void BtaRos::onSubscribers()
+{
+    boost::mutex::scoped_lock lock(demand_mutex_);
+    demand_cond_.notify_all();
+}
+
+bool BtaRos::acquireFrame(BTA_Frame **frame, ros::Time &stamp)
+{
+    // While the supervisor reconnects there is nothing to fetch
+    if (!waitConnected(0.1))
+	return false;
+    // The new connection starts in the configured frame mode at full rate
+    if (reconnected_.exchange(false)) {
+	frameMode_ = config_.frameMode;
+	suspended_ = false;
+    }
+
+    bool subscribed = isSubscribed();
+    // While grabbing, frames have to be fetched to keep the SDK capturing
+    if (!subscribed && !grabbing_ && !frameLog_) {
+	setSuspended(true);
+	// Woken up by the next subscriber; demand of in-process consumers
+	// is polled
+	boost::mutex::scoped_lock lock(demand_mutex_);
+	demand_cond_.timed_wait(lock, boost::posix_time::milliseconds(100));
+	return false;
+    }
+    setSuspended(false);
+
+    // Only ask the camera for the channels somebody needs
+    BTA_FrameMode frameMode = requiredFrameMode();
+    if (frameMode != frameMode_) {
+	frameMode_ = frameMode;
+	commands_->post("frameMode", boost::bind(&BtaRos::setFrameMode, this, frameMode));
+    }
+
+    BTA_Status status;
+    ros::WallTime start = ros::WallTime::now();
+    {
+	boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+	status = BTAgetFrame(handle_, frame, frameTimeout_);
+	// A frame that is there right away was waiting in the queue
+	frameQueued_ = (ros::WallTime::now() - start).toSec() < 0.001;
+	// The device clock is not synchronized with the host, frames of
+	// different cameras are only comparable in host time
+	stamp = ros::Time::now();
+	// A late frame is the first hint of a lost link, do not wait for the
+	// supervisor to poll
+	if (status != BTA_StatusOk && !BTAisConnected(handle_)) {
+	    handle_lock.unlock();
+	    onLinkLost();
+	}
+    }
     if (status != BTA_StatusOk) {
+	// Some failures come back right away, e.g. a device error while
+	// still connected: do not let the acquisition loop spin on them
+	double idle = 0.01 - (ros::WallTime::now() - start).toSec();
+	if (idle > 0)
+	    ros::WallDuration(idle).sleep();
+	return false;
+    }
+    if (frameLog_ && !frameLog_->append(*frame))
+	ROS_WARN_THROTTLE(5, "Could not append frame to the frame log");
+    if (!subscribed) {
+	BTAfreeFrame(frame);
+	return false;
+    }
+    return true;
+}
+
+/**
+ *
+ * @brief Packed points of the published cloud: float32 x, y, z in m at
+ * offsets 0, 4 and 8 and uint16 intensity at 12.
+ *
+ */
+struct PackedPoints
+{
+    uint8_t *data;
+    size_t step;
+    void operator()(size_t i, const float p[3], float intensity) const
+    {
+	uint16_t value = intensity;
+	memcpy(data + i*step, p, 3*sizeof(float));
+	memcpy(data + i*step + 3*sizeof(float), &value, sizeof(value));
+    }
+};
+
+struct PclPoints
+{
+    pcl::PointXYZI *points;
+    void operator()(size_t i, const float p[3], float intensity) const
+    {
+	points[i].x = p[0];
+	points[i].y = p[1];
+	points[i].z = p[2];
+	points[i].intensity = intensity;
+    }
+};
+
+struct GridPoints
+{
+    HeightMap *map;
+    void operator()(size_t, const float p[3], float) const
+    {
+	map->add(p);
+    }
+};
+
+struct XYZPoints
+{
+    float *points;
+    void operator()(size_t i, const float p[3], float) const
+    {
+	memcpy(points + 3*i, p, 3*sizeof(float));
+    }
+};
+
+// Feeds the points to two writers in the same pass
+template <typename A, typename B>
+struct BothPoints
+{
+    A a;
+    B b;
+    void operator()(size_t i, const float p[3], float intensity) const
+    {
+	a(i, p, intensity);
+	b(i, p, intensity);
+    }
+};
+
+template <typename T, typename Points>
+static void writePoints(const Points &out, const T *x, const T *y, const T *z,
+			float conv, const void *amplitudes,
+			BTA_DataFormat amDataFormat, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+	float p[3] = { x[i]*conv, y[i]*conv, z[i]*conv };
+	float intensity = 255;
+	if (amplitudes && amDataFormat == BTA_DataFormatUInt16)
+	    intensity = static_cast<const uint16_t *>(amplitudes)[i];
+	else if (amplitudes && amDataFormat == BTA_DataFormatFloat32)
+	    intensity = static_cast<const float *>(amplitudes)[i];
+	out(i, p, intensity);
+    }
+}
+
+template <typename Points>
+static bool writePoints(const Points &out, const void *x, const void *y,
+			const void *z, BTA_DataFormat dataFormat, float conv,
+			const void *amplitudes, BTA_DataFormat amDataFormat, size_t count)
+{
+    if (dataFormat == BTA_DataFormatSInt16)
+	writePoints(out, static_cast<const int16_t *>(x),
+		    static_cast<const int16_t *>(y), static_cast<const int16_t *>(z),
+		    conv, amplitudes, amDataFormat, count);
+    else if (dataFormat == BTA_DataFormatFloat32)
+	writePoints(out, static_cast<const float *>(x),
+		    static_cast<const float *>(y), static_cast<const float *>(z),
+		    conv, amplitudes, amDataFormat, count);
+    else
+	return false;
+    return true;
+}
+
+bool BtaRos::writeCloud(uint8_t *data, size_t pointStep, const void *x, const void *y,
+			const void *z, BTA_DataFormat dataFormat, float conv,
+			const void *amplitudes, BTA_DataFormat amDataFormat, size_t count,
+			HeightMap *map)
+{
+    PackedPoints out = { data, pointStep };
+    if (map) {
+	GridPoints grid = { map };
+	BothPoints<PackedPoints, GridPoints> both = { out, grid };
+	return writePoints(both, x, y, z, dataFormat, conv, amplitudes, amDataFormat, count);
+    }
+    return writePoints(out, x, y, z, dataFormat, conv, amplitudes, amDataFormat, count);
+}
+
+bool BtaRos::writeCloud(pcl::PointXYZI *points, const void *x, const void *y,
+			const void *z, BTA_DataFormat dataFormat, float conv,
+			const void *amplitudes, BTA_DataFormat amDataFormat, size_t count)
+{
+    PclPoints out = { points };
+    return writePoints(out, x, y, z, dataFormat, conv, amplitudes, amDataFormat, count);
+}
+
+bool BtaRos::writeHeightMap(HeightMap &map, const void *x, const void *y, const void *z,
+			    BTA_DataFormat dataFormat, float conv, size_t count)
+{
+    GridPoints grid = { &map };
+    return writePoints(grid, x, y, z, dataFormat, conv, NULL, BTA_DataFormatUInt16, count);
+}
+
+bool BtaRos::writeXYZ(float *points, const void *x, const void *y, const void *z,
+		      BTA_DataFormat dataFormat, float conv, size_t count)
+{
+    XYZPoints out = { points };
+    return writePoints(out, x, y, z, dataFormat, conv, NULL, BTA_DataFormatUInt16, count);
+}
+
+bool BtaRos::groundWanted()
+{
+    return groundSegmenter_ && (pub_ground_plane_.getNumSubscribers() > 0 ||
+				pub_ground_.getNumSubscribers() > 0 ||
+				pub_obstacles_.getNumSubscribers() > 0);
+}
+
+void BtaRos::segmentGround(const void *x, const void *y, const void *z, BTA_DataFormat dataFormat,
+			   float conv, uint16_t xRes, uint16_t yRes, uint32_t frameCounter,
+			   const ros::Time &stamp)
+{
+    if (!writeXYZ(groundSegmenter_->points(xRes, yRes), x, y, z, dataFormat, conv, xRes*yRes))
 	return;
+
+    bta_tof_driver::GroundPlanePtr plane(new bta_tof_driver::GroundPlane);
+    groundSegmenter_->segment(*plane);
+    plane->header.seq = frameCounter;
+    plane->header.stamp = stamp;
+    plane->header.frame_id = cloudFrameId_;
+    pub_ground_plane_.publish(plane);
+
+    if (pub_ground_.getNumSubscribers() > 0 || pub_obstacles_.getNumSubscribers() > 0) {
+	sensor_msgs::PointCloud2Ptr ground(new sensor_msgs::PointCloud2);
+	sensor_msgs::PointCloud2Ptr obstacles(new sensor_msgs::PointCloud2);
+	groundSegmenter_->split(*ground, *obstacles);
+	ground->header = plane->header;
+	obstacles->header = plane->header;
+	pub_ground_.publish(ground);
+	pub_obstacles_.publish(obstacles);
+    }
+}
+
+bool BtaRos::shmCloudWanted()
+{
+    return shmSlots_ > 0 && pub_shm_cloud_.getNumSubscribers() > 0;
+}
+
+bool BtaRos::shmDistancesWanted()
+{
+    return shmSlots_ > 0 && pub_shm_dis_.getNumSubscribers() > 0;
+}
+
+uint8_t *BtaRos::beginShmSlot(boost::scoped_ptr<ShmRingWriter> &ring, const std::string &suffix,
+			      size_t size, uint32_t &slot)
+{
+    if (!ring) {
+	// Sized after the first frame unless configured
+	std::string name = "/bta_tof_driver" + nodeName_ + "_" + suffix;
+	std::replace(name.begin() + 1, name.end(), '/', '_');
+	ring.reset(new ShmRingWriter(name, shmSlots_, shmSlotSize_ > 0 ? shmSlotSize_ : size));
+	if (!ring->isOpen())
+	    ROS_WARN_STREAM("Could not create shared memory ring " << name);
+	else
+	    ROS_INFO_STREAM("Shared memory ring " << name << ": " << shmSlots_ <<
+			    " slots of " << ring->getSlotSize() << " bytes");
     }
+    uint8_t *data = ring->begin(size, slot);
+    if (!data && ring->isOpen())
+	ROS_WARN_STREAM_THROTTLE(5, "Frame of " << size << " bytes does not fit into " <<
+				 ring->getName() << ", set shmSlotSize");
+    return data;
+}
+
+void BtaRos::publishShmSlot(boost::scoped_ptr<ShmRingWriter> &ring, ros::Publisher &pub,
+			    uint32_t slot, uint32_t frameCounter, const ros::Time &stamp,
+			    const std::string &frameId, uint32_t width, uint32_t height,
+			    uint32_t step, const std::string &encoding)
+{
+    ShmSlotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.frameCounter = frameCounter;
+    header.stampSec = stamp.sec;
+    header.stampNsec = stamp.nsec;
+    header.width = width;
+    header.height = height;
+    header.step = step;
+    strncpy(header.encoding, encoding.c_str(), sizeof(header.encoding) - 1);
+
+    bta_tof_driver::ShmSlotPtr msg(new bta_tof_driver::ShmSlot);
+    msg->header.seq = frameCounter;
+    msg->header.stamp = stamp;
+    msg->header.frame_id = frameId;
+    msg->ring = ring->getName();
+    msg->slot = slot;
+    msg->sequence = ring->commit(slot, header);
+    msg->size = height*step;
+    pub.publish(msg);
+}
+
+bool BtaRos::isAdmitted(LoadShedder::Output output)
+{
+    return !shedder_ || shedder_->admitted(output);
+}
+
+void BtaRos::recordCost(LoadShedder::Output output, const ros::WallTime &start)
+{
+    if (shedder_)
+	shedder_->record(output, (ros::WallTime::now() - start).toSec());
+}
+
+void BtaRos::getShedStats(LoadShedder::Stats &stats, bool &enabled)
+{
+    enabled = shedder_.get() != NULL;
+    if (shedder_)
+	shedder_->getStats(stats);
+}
+
+void BtaRos::processFrame(BTA_Frame *frame, const ros::Time &stamp)
+{
+    BTA_Status status;
 
     ROS_DEBUG("		frameArrived FrameCounter %d", frame->frameCounter);
 
@@ -268,13 +1024,33 @@ void BtaRos::publishData()
     sensor_msgs::CameraInfoPtr ci_tof(new sensor_msgs::CameraInfo(cim_tof_.getCameraInfo()));
     ci_tof->header.frame_id = nodeName_+"/tof_camera";
 
+    bool cloudWanted = pub_xyz_.getNumSubscribers() > 0 || (cloudDemand_ && cloudDemand_());
+    bool pclWanted = pub_pcl_.getNumSubscribers() > 0;
+    bool gridWanted = heightMap_ && pub_height_map_.getNumSubscribers() > 0;
+    bool ground = groundWanted();
+    if (shedder_) {
+	bool wanted[LoadShedder::Outputs];
+	wanted[LoadShedder::Amplitudes] = pub_amp_.getNumSubscribers() > 0;
+	wanted[LoadShedder::Distances] = pub_dis_.getNumSubscribers() > 0 ||
+	    (distancesDemand_ && distancesDemand_()) || shmDistancesWanted();
+	wanted[LoadShedder::Cloud] = cloudWanted || pclWanted || gridWanted || ground ||
+	    shmCloudWanted();
+	shedder_->plan(stamp, frame->frameCounter, frameQueued_, wanted);
+    }
+    ros::WallTime start = ros::WallTime::now();
 
     void *distances;
     status = BTAgetDistances(frame, &distances, &dataFormat, &unit, &xRes, &yRes);
-    if (status == BTA_StatusOk) {
+    if (status == BTA_StatusOk && reducer_) {
+	reducer_->adjust(*ci_tof, xRes, yRes);
+	distances = reducer_->reduce(FrameReducer::Distances, distances, dataFormat, xRes, yRes);
+    }
+    if (status == BTA_StatusOk && isAdmitted(LoadShedder::Distances) &&
+	    (!shmDistancesWanted() || pub_dis_.getNumSubscribers() > 0 ||
+	     (distancesDemand_ && distancesDemand_()))) {
 	sensor_msgs::ImagePtr dis (new sensor_msgs::Image);
 	dis->header.seq = frame->frameCounter;
-	dis->header.stamp.sec = frame->timeStamp;
+	dis->header.stamp = stamp;
 	dis->height = yRes;
 	dis->width = xRes;
 	dis->encoding = getDataType(dataFormat);
@@ -284,6 +1060,34 @@ void BtaRos::publishData()
 
 	dis->header.frame_id = "distances";
 	pub_dis_.publish(dis,ci_tof);
+	if (distancesCallback_ && distancesDemand_())
+	    distancesCallback_(dis);
+	recordCost(LoadShedder::Distances, start);
+    }
+    if (status == BTA_StatusOk && shmDistancesWanted() && isAdmitted(LoadShedder::Distances)) {
+	uint32_t slot;
+	size_t size = xRes*yRes*getDataSize(dataFormat);
+	uint8_t *data = beginShmSlot(shm_dis_, "distances", size, slot);
+	if (data) {
+	    memcpy(data, distances, size);
+	    publishShmSlot(shm_dis_, pub_shm_dis_, slot, frame->frameCounter, stamp,
+			   "distances", xRes, yRes, xRes*getDataSize(dataFormat),
+			   getDataType(dataFormat));
+	}
+    }
+    if (status == BTA_StatusOk && pub_scan_.getNumSubscribers() > 0) {
+	sensor_msgs::LaserScanPtr scan(new sensor_msgs::LaserScan);
+	if (scanExtractor_->extract(*ci_tof, distances, dataFormat, getUnit2Meters(unit),
+				    xRes, yRes, *scan)) {
+	    scan->header.seq = frame->frameCounter;
+	    scan->header.stamp = stamp;
+	    scan->scan_time = lastScanStamp_.isZero() ? 0 : (stamp - lastScanStamp_).toSec();
+	    lastScanStamp_ = stamp;
+	    pub_scan_.publish(scan);
+	} else {
+	    ROS_WARN_STREAM_THROTTLE(5, "No scan without camera intrinsics or for BTA_DataFormat " <<
+				     dataFormat);
+	}
     }
 
     bool ampOk = false;
@@ -292,9 +1096,25 @@ void BtaRos::publishData()
     status = BTAgetAmplitudes(frame, &amplitudes,
 			      &amDataFormat, &unit, &xRes, &yRes);
     if (status == BTA_StatusOk) {
+	ampOk = true;
+	if (reducer_) {
+	    reducer_->adjust(*ci_tof, xRes, yRes);
+	    amplitudes = reducer_->reduce(FrameReducer::Amplitudes, amplitudes, amDataFormat,
+					  xRes, yRes);
+	}
+
+	uint32_t integrationTime;
+	if (autoExposure_ &&
+		autoExposure_->update(amplitudes, amDataFormat, xRes*yRes, integrationTime))
+	    commands_->post("autoIntegrationTime", boost::bind(&BtaRos::runOnHandle, this,
+			    HandleCommand(boost::bind(&BTAsetIntegrationTime, _1, integrationTime)),
+			    (BTA_Status *)NULL, true));
+    }
+    if (ampOk && isAdmitted(LoadShedder::Amplitudes)) {
+	start = ros::WallTime::now();
 	sensor_msgs::ImagePtr amp (new sensor_msgs::Image);
 	amp->header.seq = frame->frameCounter;
-	amp->header.stamp.sec = frame->timeStamp;
+	amp->header.stamp = stamp;
 	amp->height = yRes;
 	amp->width = xRes;
 	amp->encoding = getDataType(amDataFormat);
@@ -304,12 +1124,26 @@ void BtaRos::publishData()
 
 	amp->header.frame_id = "amplitudes";//nodeName_+"/tof_camera";
 	pub_amp_.publish(amp,ci_tof);
-	ampOk = true;
+	recordCost(LoadShedder::Amplitudes, start);
     }
 
     void *xCoordinates, *yCoordinates, *zCoordinates;
+    start = ros::WallTime::now();
     status = BTAgetXYZcoordinates(frame, &xCoordinates, &yCoordinates, &zCoordinates, &dataFormat, &unit, &xRes, &yRes);
-    if (status == BTA_StatusOk) {
+    if (status == BTA_StatusOk && reducer_)
+	reducer_->reducePoints(xCoordinates, yCoordinates, zCoordinates, dataFormat, xRes, yRes);
+    bool cloudConverted = false;
+    // The height map is filled along with the first conversion of the cloud
+    HeightMap *grid = NULL;
+    bool gridFilled = false;
+    if (status == BTA_StatusOk && gridWanted && isAdmitted(LoadShedder::Cloud)) {
+	heightMap_->clear();
+	grid = heightMap_.get();
+    }
+    if (status == BTA_StatusOk && cloudWanted && isAdmitted(LoadShedder::Cloud)) {
+	// The last cloud may still be held by a subscriber in this process
+	if (!_xyz.unique())
+	    _xyz.reset(new sensor_msgs::PointCloud2);
 	if (_xyz->width != xRes || _xyz->height != yRes || _xyz->fields.size() != 4) {
 	    _xyz->width = xRes;
 	    _xyz->height = yRes;
@@ -319,7 +1153,7 @@ void BtaRos::publishData()
 					      "z", 1, sensor_msgs::PointField::FLOAT32,
 					      "intensity", 1, sensor_msgs::PointField::UINT16);
 	    modifier.resize(_xyz->height * _xyz->width);
-	    _xyz->header.frame_id = "cloud";
+	    _xyz->header.frame_id = cloudFrameId_;
 	    _xyz->is_dense = true;
 	}
 	//if (_cloud.size() != yRes*xRes) {
@@ -330,50 +1164,18 @@ void BtaRos::publishData()
 	    return;
 	}*/
 	float conv = getUnit2Meters(unit);
-	sensor_msgs::PointCloud2Iterator<float> _x(*_xyz, "x");
-	sensor_msgs::PointCloud2Iterator<float> _y(*_xyz, "y");
-	sensor_msgs::PointCloud2Iterator<float> _z(*_xyz, "z");
-	sensor_msgs::PointCloud2Iterator<unsigned short> _i(*_xyz, "intensity");
-	if (dataFormat == BTA_DataFormatSInt16) {
-	    /*short *xC, *yC, *zC;
-	    xC = (short *)xCoordinates;
-	    yC = (short *)yCoordinates;
-	    zC = (short *)zCoordinates;*/
-	    for (size_t i = 0; i < yRes*xRes; i++, ++_x, ++_y, ++_z, ++_i) {
-		*_x = static_cast<short *>(xCoordinates)[i]*conv;
-		*_y = static_cast<short *>(yCoordinates)[i]*conv;
-		*_z = static_cast<short *>(zCoordinates)[i]*conv;
-		if (ampOk) {
-		    if(amDataFormat == BTA_DataFormatUInt16) {
-			*_i = static_cast<unsigned short *>(amplitudes)[i];
-		    } else if(amDataFormat == BTA_DataFormatFloat32) {
-			*_i = static_cast<float *>(amplitudes)[i];
-		    }
-		} else
-		    *_i = 255;
-	    }
-	} else if (dataFormat == BTA_DataFormatFloat32) {
-	    for (size_t i = 0; i < yRes*xRes; i++, ++_x, ++_y, ++_z, ++_i) {
-		*_x = static_cast<float *>(xCoordinates)[i]*conv;
-		*_y = static_cast<float *>(yCoordinates)[i]*conv;
-		*_z = static_cast<float *>(zCoordinates)[i]*conv;
-		if (ampOk) {
-		    if(amDataFormat == BTA_DataFormatUInt16) {
-			*_i = static_cast<unsigned short *>(amplitudes)[i];
-		    } else if(amDataFormat == BTA_DataFormatFloat32) {
-			*_i = static_cast<float *>(amplitudes)[i];
-		    }
-		} else
-		    *_i = 255;
-	    }
-	} else {
+	// The modifier above packs x, y, z and intensity without gaps
+	if (!writeCloud(&_xyz->data[0], _xyz->point_step, xCoordinates, yCoordinates,
+			zCoordinates, dataFormat, conv, ampOk ? amplitudes : NULL,
+			amDataFormat, xRes*yRes, grid)) {
 	    ROS_WARN_STREAM("Unhandled BTA_DataFormat: " << dataFormat);
+	    BTAfreeFrame(&frame);
 	    return;
 	}
 	//pcl::toROSMsg(_cloud, *_xyz);
 
 	_xyz->header.seq = frame->frameCounter;
-	_xyz->header.stamp.sec = frame->timeStamp;
+	_xyz->header.stamp = stamp;
 
 	//Keeping until resolving problem with rviz
 	/*
@@ -408,6 +1210,68 @@ void BtaRos::publishData()
 		*/
 
 	pub_xyz_.publish(_xyz);
+	if (cloudCallback_)
+	    cloudCallback_(_xyz);
+	cloudConverted = true;
+	gridFilled = grid != NULL;
+    }
+    if (status == BTA_StatusOk && pub_pcl_.getNumSubscribers() > 0 &&
+	    isAdmitted(LoadShedder::Cloud)) {
+	// Reused unless a subscriber in this process still holds the last one
+	if (!_pcl || !_pcl.unique())
+	    _pcl.reset(new PclCloud);
+	if (_pcl->width != xRes || _pcl->height != yRes || _pcl->size() != xRes*yRes) {
+	    _pcl->width = xRes;
+	    _pcl->height = yRes;
+	    _pcl->resize(xRes*yRes);
+	    _pcl->header.frame_id = cloudFrameId_;
+	    _pcl->is_dense = true;
+	}
+	if (writeCloud(&_pcl->points[0], xCoordinates, yCoordinates, zCoordinates,
+		       dataFormat, getUnit2Meters(unit), ampOk ? amplitudes : NULL,
+		       amDataFormat, xRes*yRes)) {
+	    _pcl->header.seq = frame->frameCounter;
+	    pcl_conversions::toPCL(stamp, _pcl->header.stamp);
+	    pub_pcl_.publish(_pcl);
+	}
+	cloudConverted = true;
+    }
+    if (grid && !gridFilled)
+	gridFilled = writeHeightMap(*grid, xCoordinates, yCoordinates, zCoordinates,
+				    dataFormat, getUnit2Meters(unit), xRes*yRes);
+    if (gridFilled) {
+	bta_tof_driver::HeightGridPtr msg(new bta_tof_driver::HeightGrid);
+	grid->toMsg(*msg);
+	msg->header.seq = frame->frameCounter;
+	msg->header.stamp = stamp;
+	pub_height_map_.publish(msg);
+	cloudConverted = true;
+    }
+    if (status == BTA_StatusOk && ground && isAdmitted(LoadShedder::Cloud)) {
+	segmentGround(xCoordinates, yCoordinates, zCoordinates, dataFormat, getUnit2Meters(unit),
+		      xRes, yRes, frame->frameCounter, stamp);
+	cloudConverted = true;
+    }
+    // All cloud outputs count as one
+    if (cloudConverted)
+	recordCost(LoadShedder::Cloud, start);
+    if (status == BTA_StatusOk && shmCloudWanted() && isAdmitted(LoadShedder::Cloud)) {
+	// Straight into the slot, or a copy of the cloud converted anyway
+	uint32_t slot;
+	size_t pointStep = 3*sizeof(float) + sizeof(uint16_t);
+	uint8_t *data = beginShmSlot(shm_cloud_, "cloud", xRes*yRes*pointStep, slot);
+	bool ok = false;
+	if (data && cloudWanted && cloudConverted && _xyz->point_step == pointStep) {
+	    memcpy(data, &_xyz->data[0], xRes*yRes*pointStep);
+	    ok = true;
+	} else if (data) {
+	    ok = writeCloud(data, pointStep, xCoordinates, yCoordinates, zCoordinates,
+			    dataFormat, getUnit2Meters(unit), ampOk ? amplitudes : NULL,
+			    amDataFormat, xRes*yRes);
+	}
+	if (ok)
+	    publishShmSlot(shm_cloud_, pub_shm_cloud_, slot, frame->frameCounter, stamp,
+			   cloudFrameId_, xRes, yRes, xRes*pointStep, "xyz32f_i16u");
     }
 
     BTAfreeFrame(&frame);
@@ -538,6 +1402,22 @@ void BtaRos::parseConfig() {
 	config_.uartReceiverAddress = (uint8_t)iusValue;
     if(nh_private_.getParam(nodeName_+"/serialNumber",iusValue))
 	config_.serialNumber = (uint32_t)iusValue;
+    if(nh_private_.getParam(nodeName_+"/productOrderNumber",pon_))
+	config_.pon = (uint8_t *)pon_.c_str();
+
+    nh_private_.param(nodeName_+"/keepAliveInterval",keepAliveInterval_,0.5);
+    nh_private_.param(nodeName_+"/linkPollInterval",linkPollInterval_,0.05);
+    nh_private_.param(nodeName_+"/reconnectMinDelay",reconnectMinDelay_,0.1);
+    nh_private_.param(nodeName_+"/reconnectMaxDelay",reconnectMaxDelay_,5.0);
+    if (nh_private_.getParam(nodeName_+"/frameTimeout",frameTimeout_))
+	frameTimeoutAuto_ = false;
+
+    nh_private_.param(nodeName_+"/discovery",discovery_,false);
+    nh_private_.param(nodeName_+"/discoveryTimeout",discoveryTimeout_,3.0);
+    if (!nh_private_.getParam(nodeName_+"/discoveryCacheFile",discoveryCacheFile_))
+	discoveryCacheFile_ = rosCacheFile(nodeName_, ".cache");
+    else
+	discoveryCacheFile_ = expandHome(discoveryCacheFile_);
 
     nh_private_.getParam(nodeName_+"/calibFileName",calibFileName_);
     config_.calibFileName = (uint8_t *)calibFileName_.c_str();
@@ -545,6 +1425,9 @@ void BtaRos::parseConfig() {
     int32_t frameMode;
     if (nh_private_.getParam(nodeName_+"/frameMode",frameMode))
 	config_.frameMode = (BTA_FrameMode)frameMode;
+    frameMode_ = config_.frameMode;
+    nh_private_.getParam(nodeName_+"/autoFrameMode", autoFrameMode_);
+    nh_private_.getParam(nodeName_+"/idleFrameRate", idleFrameRate_);
 
     if (nh_private_.getParam(nodeName_+"/verbosity",iusValue))
 	config_.verbosity = (uint8_t)iusValue;
@@ -562,20 +1445,128 @@ void BtaRos::parseConfig() {
 	config_.deviceType = (BTA_DeviceType)deviceType;
 #endif
 
+    nh_private_.getParam(nodeName_+"/parentFrameId",parentFrameId_);
+    // Unique per camera, tf frame ids have no leading slash
+    cloudFrameId_ = (!nodeName_.empty() && nodeName_[0] == '/' ? nodeName_.substr(1) : nodeName_) +
+	"/cloud";
+    nh_private_.getParam(nodeName_+"/cloudFrameId",cloudFrameId_);
+
     //config_.frameArrived = &frameArrived;
     config_.infoEvent = &infoEventCb;
 }
 
+void BtaRos::publishExtrinsics()
+{
+    std::vector<double> extrinsics;
+    if (nh_private_.getParam(nodeName_+"/extrinsics",extrinsics) && extrinsics.size() != 6) {
+	ROS_WARN_STREAM("extrinsics must be [x, y, z, roll, pitch, yaw], using identity");
+	extrinsics.clear();
+    }
+    extrinsics.resize(6, 0.0);
+
+    transformStamped.header.stamp = ros::Time::now();
+    transformStamped.header.frame_id = parentFrameId_;
+    transformStamped.child_frame_id = cloudFrameId_;
+    transformStamped.transform.translation.x = extrinsics[0];
+    transformStamped.transform.translation.y = extrinsics[1];
+    transformStamped.transform.translation.z = extrinsics[2];
+    tf::Quaternion q;
+    q.setRPY(extrinsics[3], extrinsics[4], extrinsics[5]);
+    transformStamped.transform.rotation.x = q.x();
+    transformStamped.transform.rotation.y = q.y();
+    transformStamped.transform.rotation.z = q.z();
+    transformStamped.transform.rotation.w = q.w();
+    if (extrinsicsCallback_) {
+	extrinsicsCallback_(transformStamped);
+	return;
+    }
+    if (!pub_tf)
+	pub_tf.reset(new tf2_ros::StaticTransformBroadcaster);
+    pub_tf->sendTransform(transformStamped);
+}
+
+void BtaRos::setExtrinsicsCallback(const TransformCallback &callback)
+{
+    extrinsicsCallback_ = callback;
+}
+
+void BtaRos::setCloudCallback(const CloudCallback &callback, const DemandCallback &demand)
+{
+    cloudCallback_ = callback;
+    cloudDemand_ = demand;
+}
+
+void BtaRos::setDistancesCallback(const ImageCallback &callback, const DemandCallback &demand)
+{
+    distancesCallback_ = callback;
+    distancesDemand_ = demand;
+}
+
+
+
+void BtaRos::applyDiscoveredDevice(const DiscoveredDevice &device)
+{
+    size_t len = std::min(device.deviceIpAddr.size(), sizeof(tcpDeviceIpAddr_));
+    std::copy(device.deviceIpAddr.begin(), device.deviceIpAddr.begin() + len, tcpDeviceIpAddr_);
+    config_.tcpDeviceIpAddr = tcpDeviceIpAddr_;
+    config_.tcpDeviceIpAddrLen = (uint8_t)len;
+    if (device.tcpControlPort)
+	config_.tcpControlPort = device.tcpControlPort;
+    if (device.tcpDataPort)
+	config_.tcpDataPort = device.tcpDataPort;
+    if (!device.udpDataIpAddr.empty()) {
+	len = std::min(device.udpDataIpAddr.size(), sizeof(udpDataIpAddr_));
+	std::copy(device.udpDataIpAddr.begin(), device.udpDataIpAddr.begin() + len, udpDataIpAddr_);
+	config_.udpDataIpAddr = udpDataIpAddr_;
+	config_.udpDataIpAddrLen = (uint8_t)len;
+    }
+    if (device.udpDataPort)
+	config_.udpDataPort = device.udpDataPort;
+    config_.serialNumber = device.serialNumber;
+
+    ROS_INFO_STREAM("Using device " << device.productOrderNumber <<
+		    " serial " << device.serialNumber << " at " <<
+		    (int)tcpDeviceIpAddr_[0] << "." << (int)tcpDeviceIpAddr_[1] << "." <<
+		    (int)tcpDeviceIpAddr_[2] << "." << (int)tcpDeviceIpAddr_[3]);
+}
+
+int BtaRos::connectDevice(int attempts)
+{
+    if (!discovery_)
+	return connectCamera(attempts);
+
+    uint32_t serial = config_.serialNumber;
+    DiscoveredDevice device;
+    // The last known address usually still works and saves a discovery round
+    if (DeviceDiscovery::loadCache(discoveryCacheFile_, serial, pon_, &device)) {
+	applyDiscoveredDevice(device);
+	if (connectCamera(1) > 0)
+	    return 1;
+	ROS_INFO_STREAM("Cached address did not answer, starting discovery.");
+    }
 
+    if (!DeviceDiscovery::discover((BTA_DeviceType)0, serial, pon_,
+				   discoveryTimeout_, &device)) {
+	ROS_WARN_STREAM("No device with serial " << serial << " and PON '" <<
+			pon_ << "' discovered.");
+	return -1;
+    }
+    applyDiscoveredDevice(device);
+    if (connectCamera(attempts) < 0)
+	return -1;
+    if (!DeviceDiscovery::saveCache(discoveryCacheFile_, device))
+	ROS_WARN_STREAM("Could not write discovery cache " << discoveryCacheFile_);
+    return 1;
+}
 
-int BtaRos::connectCamera() {
+int BtaRos::connectCamera(int attempts) {
     BTA_Status status;
     BTA_DeviceInfo *deviceInfo;
 
     // Init camera connection
     //ros::Duration().sleep();
     status = (BTA_Status)-1;
-    for (int i=0; i<10; i++) {
+    for (int i=0; i<attempts; i++) {
 	ROS_INFO_STREAM("Connecting... try " << i+1);
 	status = BTAopen(&config_, &handle_);
 	if (status != BTA_StatusOk) {
@@ -586,7 +1577,8 @@ int BtaRos::connectCamera() {
 	}
 	break;
     }
-    if (!BTAisConnected(handle_)) {
+    handleOpen_ = (status == BTA_StatusOk);
+    if (!handleOpen_ || !BTAisConnected(handle_)) {
 	ROS_WARN_STREAM("Could not connect to the camera.");
 	return -1;
     }
@@ -613,7 +1605,7 @@ int BtaRos::connectCamera() {
     return 1;
 }
 
-int BtaRos::initialize()
+int BtaRos::setup()
 {
 
     /*
@@ -623,6 +1615,7 @@ int BtaRos::initialize()
     BTAinitConfig(&config_);
 
     parseConfig();
+    publishExtrinsics();
 
     /*
 			 * Camera Initialization
@@ -630,16 +1623,131 @@ int BtaRos::initialize()
     ROS_DEBUG_STREAM("Config Readed sucessfully");
 
     BTA_Status status;
-    if (connectCamera() < 0)
+    if (connectDevice() < 0)
 	return -1;
+    connected_ = true;
+    applyLinkSettings();
+
+    // Control requests are served by a spinner of their own, so they
+    // neither wait for frames nor delay them
+    double controlBudget = 0.5;
+    nh_private_.getParam(nodeName_+"/controlBudget", controlBudget);
+    commands_.reset(new CommandExecutor(controlBudget));
+
+    int shmSlots = 0, shmSlotSize = 0;
+    nh_private_.getParam(nodeName_+"/shmSlots", shmSlots);
+    nh_private_.getParam(nodeName_+"/shmSlotSize", shmSlotSize);
+    shmSlots_ = std::max(shmSlots, 0);
+    shmSlotSize_ = std::max(shmSlotSize, 0);
+
+    bool loadShedding = false;
+    nh_private_.getParam(nodeName_+"/loadShedding", loadShedding);
+    if (loadShedding) {
+	LoadShedder::Policy policies[LoadShedder::Outputs];
+	double loadLimit = 0.8;
+	nh_private_.getParam(nodeName_+"/loadLimit", loadLimit);
+	for (int i = 0; i < LoadShedder::Outputs; i++) {
+	    std::string name = LoadShedder::getName((LoadShedder::Output)i);
+	    policies[i].priority = i;
+	    nh_private_.getParam(nodeName_+"/"+name+"Priority", policies[i].priority);
+	    nh_private_.getParam(nodeName_+"/"+name+"MaxRate", policies[i].maxRate);
+	}
+	shedder_.reset(new LoadShedder(policies, loadLimit));
+    }
 
-    reconfigure_server_.reset(new ReconfigureServer(nh_private_));
+    bool autoExposure = false;
+    nh_private_.getParam(nodeName_+"/autoExposure", autoExposure);
+    if (autoExposure) {
+	AutoExposure::Settings settings;
+	int minTime = settings.minTime, maxTime = settings.maxTime;
+	nh_private_.getParam(nodeName_+"/autoExposurePercentile", settings.percentile);
+	nh_private_.getParam(nodeName_+"/autoExposureTarget", settings.target);
+	nh_private_.getParam(nodeName_+"/autoExposureSaturation", settings.saturation);
+	nh_private_.getParam(nodeName_+"/autoExposureHysteresis", settings.hysteresis);
+	nh_private_.getParam(nodeName_+"/autoExposureMaxStep", settings.maxStep);
+	nh_private_.getParam(nodeName_+"/autoExposurePeriod", settings.period);
+	nh_private_.getParam(nodeName_+"/autoExposureFrameShare", settings.frameShare);
+	nh_private_.getParam(nodeName_+"/autoExposureMinTime", minTime);
+	nh_private_.getParam(nodeName_+"/autoExposureMaxTime", maxTime);
+	settings.minTime = minTime;
+	settings.maxTime = maxTime;
+	autoExposure_.reset(new AutoExposure(settings));
+    }
+
+    FrameReducer::Settings reduction;
+    int roiX = 0, roiY = 0, roiWidth = 0, roiHeight = 0, binning = 1;
+    nh_private_.getParam(nodeName_+"/roiX", roiX);
+    nh_private_.getParam(nodeName_+"/roiY", roiY);
+    nh_private_.getParam(nodeName_+"/roiWidth", roiWidth);
+    nh_private_.getParam(nodeName_+"/roiHeight", roiHeight);
+    nh_private_.getParam(nodeName_+"/binning", binning);
+    nh_private_.getParam(nodeName_+"/binningMedian", reduction.median);
+    if (binning != 1 && binning != 2 && binning != 4) {
+	ROS_WARN_STREAM("binning must be 1, 2 or 4, not " << binning);
+	binning = 1;
+    }
+    reduction.x = std::max(roiX, 0);
+    reduction.y = std::max(roiY, 0);
+    reduction.width = std::max(roiWidth, 0);
+    reduction.height = std::max(roiHeight, 0);
+    reduction.binning = binning;
+    if (reduction.x || reduction.y || reduction.width || reduction.height || binning > 1)
+	reducer_.reset(new FrameReducer(reduction));
+
+    bool heightMap = false;
+    nh_private_.getParam(nodeName_+"/heightMap", heightMap);
+    if (heightMap) {
+	// Defaults to the parent frame of the published extrinsics
+	HeightMap::Settings settings;
+	settings.frameId = parentFrameId_;
+	nh_private_.getParam(nodeName_+"/extrinsics", settings.extrinsics);
+	nh_private_.getParam(nodeName_+"/heightMapCellSize", settings.cellSize);
+	nh_private_.getParam(nodeName_+"/heightMapLength", settings.length);
+	nh_private_.getParam(nodeName_+"/heightMapWidth", settings.width);
+	nh_private_.getParam(nodeName_+"/heightMapOriginX", settings.originX);
+	nh_private_.getParam(nodeName_+"/heightMapExtrinsics", settings.extrinsics);
+	nh_private_.getParam(nodeName_+"/heightMapFrameId", settings.frameId);
+	if (settings.extrinsics.size() != 6 && !settings.extrinsics.empty()) {
+	    ROS_WARN_STREAM("heightMapExtrinsics must be [x, y, z, roll, pitch, yaw], using identity");
+	    settings.extrinsics.clear();
+	}
+	heightMap_.reset(new HeightMap(settings));
+    }
+
+    bool groundSegmentation = false;
+    nh_private_.getParam(nodeName_+"/groundSegmentation", groundSegmentation);
+    if (groundSegmentation) {
+	// Up is z of the parent frame of the published extrinsics
+	GroundSegmenter::Settings settings;
+	nh_private_.getParam(nodeName_+"/extrinsics", settings.extrinsics);
+	nh_private_.getParam(nodeName_+"/groundDistance", settings.distance);
+	nh_private_.getParam(nodeName_+"/groundMaxAngle", settings.maxAngle);
+	nh_private_.getParam(nodeName_+"/groundMaxIterations", settings.maxIterations);
+	nh_private_.getParam(nodeName_+"/groundBudget", settings.budget);
+	nh_private_.getParam(nodeName_+"/groundStride", settings.stride);
+	groundSegmenter_.reset(new GroundSegmenter(settings));
+    }
+
+    ScanExtractor::Settings scanSettings;
+    scanSettings.frameId = cloudFrameId_;
+    nh_private_.getParam(nodeName_+"/scanFirstRow", scanSettings.firstRow);
+    nh_private_.getParam(nodeName_+"/scanRows", scanSettings.rows);
+    nh_private_.getParam(nodeName_+"/scanRangeMin", scanSettings.rangeMin);
+    nh_private_.getParam(nodeName_+"/scanRangeMax", scanSettings.rangeMax);
+    nh_private_.getParam(nodeName_+"/scanFrameId", scanSettings.frameId);
+    scanExtractor_.reset(new ScanExtractor(scanSettings));
+    nh_control_ = nh_private_;
+    nh_control_.setCallbackQueue(&control_queue_);
+    control_spinner_.reset(new ros::AsyncSpinner(1, &control_queue_));
+    control_spinner_->start();
+
+    reconfigure_server_.reset(new ReconfigureServer(nh_control_));
     reconfigure_server_->setCallback(boost::bind(&BtaRos::callback, this, _1, _2));
 
     while (!config_init_)
     {
 	ROS_DEBUG("Waiting for dynamic reconfigure configuration.");
-	boost::this_thread::sleep(boost::posix_time::seconds(0.1));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(100));
     }
     ROS_DEBUG("Dynamic reconfigure configuration received.");
 
@@ -660,20 +1768,199 @@ int BtaRos::initialize()
 			    " not found. Using an uncalibrated config_.");
 	}
 
-	pub_amp_ = it_.advertiseCamera(nodeName_ + "/tof_camera/image_raw", 1);
-	pub_dis_ = it_.advertiseCamera(nodeName_ + "/tof_camera/compressedDepth", 1);
-	pub_xyz_ = nh_private_.advertise<sensor_msgs::PointCloud2> (nodeName_ + "/tof_camera/point_cloud_xyz", 1);
+	// Wake up the suspended acquisition as soon as somebody subscribes
+	image_transport::SubscriberStatusCallback imageUpdate =
+	    boost::bind(&BtaRos::onSubscribers, this);
+	ros::SubscriberStatusCallback update = boost::bind(&BtaRos::onSubscribers, this);
+	pub_amp_ = it_.advertiseCamera(nodeName_ + "/tof_camera/image_raw", 1,
+				       imageUpdate, imageUpdate, update, update);
+	pub_dis_ = it_.advertiseCamera(nodeName_ + "/tof_camera/compressedDepth", 1,
+				       imageUpdate, imageUpdate, update, update);
+	pub_xyz_ = nh_private_.advertise<sensor_msgs::PointCloud2> (nodeName_ + "/tof_camera/point_cloud_xyz", 1,
+								    update, update);
+	if (groundSegmenter_) {
+	    pub_ground_plane_ = nh_private_.advertise<bta_tof_driver::GroundPlane> (nodeName_ + "/tof_camera/ground/plane", 1,
+										    update, update);
+	    pub_ground_ = nh_private_.advertise<sensor_msgs::PointCloud2> (nodeName_ + "/tof_camera/ground/points", 1,
+									   update, update);
+	    pub_obstacles_ = nh_private_.advertise<sensor_msgs::PointCloud2> (nodeName_ + "/tof_camera/ground/obstacles", 1,
+									      update, update);
+	}
+	if (heightMap_)
+	    pub_height_map_ = nh_private_.advertise<bta_tof_driver::HeightGrid> (nodeName_ + "/tof_camera/height_map", 1,
+										 update, update);
+	pub_scan_ = nh_private_.advertise<sensor_msgs::LaserScan> (nodeName_ + "/tof_camera/scan", 1,
+								   update, update);
+	pub_pcl_ = nh_private_.advertise<PclCloud> (nodeName_ + "/tof_camera/point_cloud_xyzi", 1,
+						    update, update);
+	if (shmSlots_ > 0) {
+	    pub_shm_cloud_ = nh_private_.advertise<bta_tof_driver::ShmSlot> (nodeName_ + "/tof_camera/shm/point_cloud_xyz", 1,
+									     update, update);
+	    pub_shm_dis_ = nh_private_.advertise<bta_tof_driver::ShmSlot> (nodeName_ + "/tof_camera/shm/distances", 1,
+									   update, update);
+	}
+
+	srv_start_grabbing_ = nh_control_.advertiseService(nodeName_ + "/start_grabbing", &BtaRos::startGrabbingCb, this);
+	srv_stop_grabbing_ = nh_control_.advertiseService(nodeName_ + "/stop_grabbing", &BtaRos::stopGrabbingCb, this);
+	srv_read_registers_ = nh_control_.advertiseService(nodeName_ + "/read_registers", &BtaRos::readRegistersCb, this);
+	srv_write_registers_ = nh_control_.advertiseService(nodeName_ + "/write_registers", &BtaRos::writeRegistersCb, this);
+
+	openFrameLog();
+
+	supervising_ = true;
+	supervisor_thread_.reset(new boost::thread(boost::bind(&BtaRos::superviseConnection, this)));
 
 	//sub_amp_ = nh_private_.subscribe("bta_node_amp", 1, &BtaRos::ampCb, this);
 	//sub_dis_ = nh_private_.subscribe("bta_node_dis", 1, &BtaRos::disCb, this);
     }
 
-    while (nh_private_.ok() && !ros::isShuttingDown()) {
-	if (!BTAisConnected(handle_)) {
-	    ROS_WARN_STREAM("The camera got disconnected." << BTAisConnected(handle_));
-	    if (connectCamera() < 0)
-		break;
+    return 0;
+}
+
+bool BtaRos::checkConnection()
+{
+    checkGrabbingRotation();
+    return nh_private_.ok() && !ros::isShuttingDown();
+}
+
+void BtaRos::applyLinkSettings()
+{
+    if (keepAliveInterval_ <= 0)
+	return;
+    BTA_Status status = BTAsetLibParam(handle_, BTA_LibParamKeepAliveMsgInterval,
+				       (float)keepAliveInterval_);
+    if (status != BTA_StatusOk)
+	ROS_DEBUG_STREAM("Keep-alive interval not supported. status: " << status);
+}
+
+void BtaRos::updateFrameTimeout(double frameRate)
+{
+    if (!frameTimeoutAuto_ || frameRate <= 0)
+	return;
+    frameTimeout_ = std::max(100, (int)(3000./frameRate));
+}
+
+bool BtaRos::waitConnected(double timeout)
+{
+    boost::mutex::scoped_lock lock(link_mutex_);
+    if (!connected_)
+	link_cond_.timed_wait(lock, boost::posix_time::milliseconds((int64_t)(timeout*1000)));
+    return connected_;
+}
+
+void BtaRos::waitLinkEvent(double timeout)
+{
+    boost::mutex::scoped_lock lock(link_mutex_);
+    if (supervising_)
+	link_cond_.timed_wait(lock, boost::posix_time::milliseconds((int64_t)(timeout*1000)));
+}
+
+void BtaRos::onLinkLost()
+{
+    boost::mutex::scoped_lock lock(link_mutex_);
+    if (!connected_)
+	return;
+    connected_ = false;
+    linkLostTime_ = ros::WallTime::now();
+    ROS_WARN_STREAM("The camera got disconnected.");
+    link_cond_.notify_all();
+}
+
+void BtaRos::getLinkStats(bool &connected, uint32_t &outages,
+			  double &lastDowntime, double &totalDowntime)
+{
+    boost::mutex::scoped_lock lock(link_mutex_);
+    connected = connected_;
+    outages = outages_;
+    lastDowntime = lastDowntime_;
+    totalDowntime = totalDowntime_;
+}
+
+bool BtaRos::reconnect()
+{
+    {
+	boost::unique_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+	if (handleOpen_) {
+	    BTAclose(&handle_);
+	    handleOpen_ = false;
 	}
+	// Whatever we knew about the registers is gone with the old handle
+	registerCache_.clear();
+	if (connectDevice(1) < 0)
+	    return false;
+	applyLinkSettings();
+
+	// The device may have been power cycled, restore what was set
+	int it;
+	double fr;
+	if (nh_private_.getParam(nodeName_+"/integrationTime", it))
+	    BTAsetIntegrationTime(handle_, (uint32_t)it);
+	if (nh_private_.getParam(nodeName_+"/frameRate", fr))
+	    BTAsetFrameRate(handle_, fr);
+	// Auto exposure has to scale from what the device has now
+	uint32_t usValue;
+	if (autoExposure_ && BTAgetIntegrationTime(handle_, &usValue) == BTA_StatusOk)
+	    autoExposure_->setIntegrationTime(usValue);
+	if (grabbing_ && !openGrabbingFile())
+	    grabbing_ = false;
+	// The acquisition loop switches again as needed
+	reconnected_ = true;
+    }
+
+    boost::mutex::scoped_lock lock(link_mutex_);
+    connected_ = true;
+    lastDowntime_ = (ros::WallTime::now() - linkLostTime_).toSec();
+    totalDowntime_ += lastDowntime_;
+    outages_++;
+    ROS_WARN_STREAM("Camera reconnected after " << lastDowntime_ <<
+		    " s (outage " << outages_ << ", total downtime " <<
+		    totalDowntime_ << " s)");
+    link_cond_.notify_all();
+    return true;
+}
+
+void BtaRos::superviseConnection()
+{
+    double delay = reconnectMinDelay_;
+    while (supervising_) {
+	bool connected;
+	{
+	    boost::mutex::scoped_lock lock(link_mutex_);
+	    connected = connected_;
+	}
+	if (connected) {
+	    // BTAisConnected only reads the state the SDK keeps up to date
+	    // with keep-alive messages, so polling it is cheap
+	    bool up;
+	    {
+		boost::shared_lock<boost::shared_mutex> handle_lock(handle_mutex_);
+		up = BTAisConnected(handle_);
+	    }
+	    if (up)
+		waitLinkEvent(linkPollInterval_);
+	    else
+		onLinkLost();
+	    continue;
+	}
+
+	if (reconnect()) {
+	    delay = reconnectMinDelay_;
+	    continue;
+	}
+	ROS_WARN_STREAM("Reconnecting failed, next try in " << delay << " s");
+	waitLinkEvent(delay);
+	delay = std::min(2*delay, reconnectMaxDelay_);
+    }
+}
+
+int BtaRos::initialize()
+{
+    if (setup() < 0)
+	return -1;
+
+    while (nh_private_.ok() && !ros::isShuttingDown()) {
+	if (!checkConnection())
+	    break;
 
 	publishData();
 	ros::spinOnce ();
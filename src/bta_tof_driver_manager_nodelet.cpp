@@ -0,0 +1,299 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/bta_tof_driver.hpp>
+#include <bta_tof_driver/cloud_fusion.hpp>
+#include <bta_tof_driver/diagnostics.hpp>
+#include <nodelet/nodelet.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/atomic.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace bta_tof_driver {
+
+/**
+ * @brief Drives several cameras from one nodelet. Every camera gets its own
+ * acquisition thread, while conversion and publishing run on a worker pool
+ * shared by all cameras.
+ *
+ * The cameras are listed in the private parameter "cameras". The parameters
+ * of each camera live in a sub-namespace named after it, as do its topics.
+ * With "fusion" set, the clouds of all cameras are also merged into one
+ * cloud published in the "fusion" sub-namespace (see CloudFusion). The
+ * extrinsics of all cameras go out through one static transform
+ * broadcaster.
+ */
+class BtaRosManagerNodelet : public nodelet::Nodelet {
+
+    struct Camera {
+	boost::shared_ptr<BtaRos> driver;
+	boost::shared_ptr<boost::asio::io_service::strand> strand;
+	boost::shared_ptr<boost::thread> thread;
+
+	boost::mutex stats_mutex;
+	bool busy;
+	uint64_t acquired, processed, dropped;
+	double processTime;
+    };
+
+public:
+    BtaRosManagerNodelet() :
+	nodelet::Nodelet(),
+	running_(false)
+    {
+    };
+
+    virtual ~BtaRosManagerNodelet()
+    {
+	running_ = false;
+	for (size_t i = 0; i < cameras_.size(); i++) {
+	    if (cameras_[i]->thread)
+		cameras_[i]->thread->join();
+	}
+	work_.reset();
+	workers_.join_all();
+    };
+
+private:
+    virtual void onInit()
+    {
+	ros::NodeHandle &nh = getNodeHandle();
+	ros::NodeHandle &nh_private = getPrivateNodeHandle();
+
+	std::vector<std::string> names;
+	if (!nh_private.getParam("cameras", names) || names.empty()) {
+	    NODELET_ERROR_STREAM("No cameras configured for " << getName());
+	    return;
+	}
+
+	int threads;
+	nh_private.param("workerThreads", threads,
+			 (int)std::max(boost::thread::hardware_concurrency() / 2, 1u));
+	threads = std::max(threads, 1);
+	double statsPeriod;
+	nh_private.param("statsPeriod", statsPeriod, 1.0);
+	bool fusion;
+	nh_private.param("fusion", fusion, false);
+	if (fusion)
+	    fusion_.reset(new CloudFusion(ros::NodeHandle(nh_private, "fusion"), names.size()));
+
+	tf_broadcaster_.reset(new tf2_ros::StaticTransformBroadcaster);
+
+	running_ = true;
+	work_.reset(new boost::asio::io_service::work(io_service_));
+	for (int i = 0; i < threads; i++)
+	    workers_.create_thread(boost::bind(&boost::asio::io_service::run, &io_service_));
+
+	for (size_t i = 0; i < names.size(); i++) {
+	    NODELET_INFO_STREAM("Initializing camera " << names[i] << "...");
+	    boost::shared_ptr<Camera> camera(new Camera);
+	    ros::NodeHandle nh_camera(nh_private, names[i]);
+	    camera->driver.reset(new BtaRos(nh_camera, nh_camera, getName() + "/" + names[i]));
+	    camera->driver->setExtrinsicsCallback(
+			boost::bind(&BtaRosManagerNodelet::addExtrinsics, this, _1));
+	    if (fusion_)
+		camera->driver->setCloudCallback(
+			    boost::bind(&CloudFusion::addCloud, fusion_.get(), i, _1),
+			    boost::bind(&CloudFusion::isSubscribed, fusion_.get()));
+	    camera->strand.reset(new boost::asio::io_service::strand(io_service_));
+	    camera->busy = false;
+	    camera->acquired = camera->processed = camera->dropped = 0;
+	    camera->processTime = 0;
+	    cameras_.push_back(camera);
+	    camera->thread.reset(new boost::thread(
+				     boost::bind(&BtaRosManagerNodelet::acquire, this, camera.get())));
+	}
+
+	pub_stats_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+	stats_timer_ = nh.createWallTimer(ros::WallDuration(statsPeriod),
+					  &BtaRosManagerNodelet::publishStats, this);
+    };
+
+    void acquire(Camera *camera)
+    {
+	if (camera->driver->setup() < 0) {
+	    NODELET_ERROR_STREAM("Could not set up " << camera->driver->getName());
+	    return;
+	}
+	while (running_ && ros::ok()) {
+	    if (!camera->driver->checkConnection())
+		break;
+
+	    BTA_Frame *frame;
+	    ros::Time stamp;
+	    if (!camera->driver->acquireFrame(&frame, stamp))
+		continue;
+
+	    boost::mutex::scoped_lock lock(camera->stats_mutex);
+	    camera->acquired++;
+	    // Never queue more than one frame per camera, a newer one is
+	    // worth more than a late one
+	    if (camera->busy) {
+		camera->dropped++;
+		BTAfreeFrame(&frame);
+		continue;
+	    }
+	    camera->busy = true;
+	    camera->strand->post(boost::bind(&BtaRosManagerNodelet::process, this, camera, frame, stamp));
+	}
+    }
+
+    void addExtrinsics(const geometry_msgs::TransformStamped &transform)
+    {
+	// The broadcaster accumulates the transforms in its latched message,
+	// the cameras set up concurrently
+	boost::mutex::scoped_lock lock(tf_mutex_);
+	tf_broadcaster_->sendTransform(transform);
+    }
+
+    void process(Camera *camera, BTA_Frame *frame, ros::Time stamp)
+    {
+	ros::WallTime start = ros::WallTime::now();
+	camera->driver->processFrame(frame, stamp);
+	double elapsed = (ros::WallTime::now() - start).toSec();
+
+	boost::mutex::scoped_lock lock(camera->stats_mutex);
+	camera->busy = false;
+	camera->processed++;
+	camera->processTime += elapsed;
+    }
+
+    void publishStats(const ros::WallTimerEvent &event)
+    {
+	if (pub_stats_.getNumSubscribers() == 0)
+	    return;
+	diagnostic_msgs::DiagnosticArrayPtr stats(new diagnostic_msgs::DiagnosticArray);
+	stats->header.stamp = ros::Time::now();
+	for (size_t i = 0; i < cameras_.size(); i++) {
+	    Camera &camera = *cameras_[i];
+	    diagnostic_msgs::DiagnosticStatus status;
+	    status.name = camera.driver->getName();
+	    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+
+	    bool connected;
+	    uint32_t outages;
+	    double lastDowntime, totalDowntime;
+	    camera.driver->getLinkStats(connected, outages, lastDowntime, totalDowntime);
+	    addValue(status, "connected", connected);
+	    addValue(status, "outages", outages);
+	    addValue(status, "last downtime [s]", lastDowntime);
+	    addValue(status, "total downtime [s]", totalDowntime);
+	    CommandExecutor::Stats commands;
+	    camera.driver->getCommandStats(commands);
+	    addValue(status, "commands", commands.executed);
+	    addValue(status, "commands expired", commands.expired);
+	    addValue(status, "commands over budget", commands.overBudget);
+	    addValue(status, "command wait [ms]", 1000.*commands.wait);
+	    addValue(status, "max command wait [ms]", 1000.*commands.maxWait);
+	    addValue(status, "max command time [ms]", 1000.*commands.maxRun);
+
+	    LoadShedder::Stats shed;
+	    bool shedding;
+	    camera.driver->getShedStats(shed, shedding);
+	    if (shedding) {
+		addValue(status, "frames behind", shed.behind);
+		for (int o = 0; o < LoadShedder::Outputs; o++) {
+		    std::string name = LoadShedder::getName((LoadShedder::Output)o);
+		    addValue(status, name + " published", shed.published[o]);
+		    addValue(status, name + " rate limited", shed.rateLimited[o]);
+		    addValue(status, name + " shed", shed.overload[o]);
+		    addValue(status, name + " cost [ms]", 1000.*shed.cost[o]);
+		}
+	    }
+	    if (!connected) {
+		status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+		status.message = "Disconnected";
+	    }
+
+	    boost::mutex::scoped_lock lock(camera.stats_mutex);
+	    addValue(status, "acquired", camera.acquired);
+	    addValue(status, "processed", camera.processed);
+	    addValue(status, "dropped", camera.dropped);
+	    addValue(status, "process time [ms]",
+		     camera.processed ? 1000.*camera.processTime/camera.processed : 0.);
+	    if (connected && camera.dropped > 0)
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+	    camera.acquired = camera.processed = camera.dropped = 0;
+	    camera.processTime = 0;
+	    stats->status.push_back(status);
+	}
+	if (fusion_) {
+	    CloudFusion::Stats fusionStats;
+	    fusion_->getStats(fusionStats);
+	    diagnostic_msgs::DiagnosticStatus status;
+	    status.name = getName() + "/fusion";
+	    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+	    addValue(status, "fused", fusionStats.fused);
+	    addValue(status, "incomplete", fusionStats.incomplete);
+	    addValue(status, "dropped", fusionStats.dropped);
+	    addValue(status, "latency [ms]", 1000.*fusionStats.latency);
+	    addValue(status, "max latency [ms]", 1000.*fusionStats.maxLatency);
+	    addValue(status, "skew [ms]", 1000.*fusionStats.skew);
+	    addValue(status, "max skew [ms]", 1000.*fusionStats.maxSkew);
+	    if (fusionStats.incomplete > 0 || fusionStats.dropped > 0)
+		status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+	    stats->status.push_back(status);
+	}
+	pub_stats_.publish(stats);
+    }
+
+    std::vector<boost::shared_ptr<Camera> > cameras_;
+    boost::scoped_ptr<CloudFusion> fusion_;
+    boost::scoped_ptr<tf2_ros::StaticTransformBroadcaster> tf_broadcaster_;
+    boost::mutex tf_mutex_;
+    boost::asio::io_service io_service_;
+    boost::scoped_ptr<boost::asio::io_service::work> work_;
+    boost::thread_group workers_;
+    boost::atomic<bool> running_;
+
+    ros::Publisher pub_stats_;
+    ros::WallTimer stats_timer_;
+};
+
+}
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(bta_tof_driver::BtaRosManagerNodelet, nodelet::Nodelet);
+
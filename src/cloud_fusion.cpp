@@ -0,0 +1,315 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/cloud_fusion.hpp>
+
+#include <string.h>
+#include <limits>
+
+namespace bta_tof_driver {
+
+CloudFusion::CloudFusion(ros::NodeHandle nh, size_t sources) :
+    nh_(nh),
+    tfListener_(tfBuffer_),
+    frameId_("world"),
+    window_(0.02),
+    tfRefresh_(1.0),
+    minClouds_(sources),
+    extrinsics_(sources),
+    slots_(sources)
+{
+    nh_.getParam("frameId", frameId_);
+    nh_.getParam("window", window_);
+    nh_.getParam("tfRefresh", tfRefresh_);
+    int minClouds;
+    if (nh_.getParam("minClouds", minClouds))
+	minClouds_ = std::min(std::max(minClouds, 1), (int)sources);
+    memset(&stats_, 0, sizeof(stats_));
+
+    pub_ = nh_.advertise<sensor_msgs::PointCloud2>("point_cloud_xyz", 1);
+}
+
+CloudFusion::~CloudFusion()
+{
+}
+
+bool CloudFusion::isSubscribed() const
+{
+    return pub_.getNumSubscribers() > 0;
+}
+
+void CloudFusion::getStats(Stats &stats)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    stats = stats_;
+    if (stats.fused > 0) {
+	stats.latency /= stats.fused;
+	stats.skew /= stats.fused;
+    }
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+void CloudFusion::addCloud(size_t source, const sensor_msgs::PointCloud2ConstPtr &cloud)
+{
+    std::vector<sensor_msgs::PointCloud2ConstPtr> group;
+    {
+	boost::mutex::scoped_lock lock(mutex_);
+	size_t count = 0;
+	for (size_t i = 0; i < slots_.size(); i++)
+	    if (slots_[i])
+		count++;
+
+	// This source is a frame ahead of the others. Publish what is there if
+	// it is enough, the late cameras are not waited for.
+	if (slots_[source]) {
+	    if (count >= minClouds_) {
+		group.swap(slots_);
+		slots_.resize(group.size());
+		stats_.incomplete++;
+	    } else {
+		stats_.dropped++;
+	    }
+	}
+	slots_[source] = cloud;
+
+	ros::Time newest = cloud->header.stamp;
+	for (size_t i = 0; i < slots_.size(); i++)
+	    if (slots_[i] && slots_[i]->header.stamp > newest)
+		newest = slots_[i]->header.stamp;
+	count = 0;
+	for (size_t i = 0; i < slots_.size(); i++) {
+	    if (!slots_[i])
+		continue;
+	    if ((newest - slots_[i]->header.stamp).toSec() > window_) {
+		slots_[i].reset();
+		stats_.dropped++;
+		continue;
+	    }
+	    count++;
+	}
+	if (count == slots_.size() && group.empty()) {
+	    group.swap(slots_);
+	    slots_.resize(group.size());
+	}
+    }
+    if (!group.empty())
+	fuse(group);
+}
+
+bool CloudFusion::lookupExtrinsics(size_t source, const std::string &frameId, float *m)
+{
+    boost::mutex::scoped_lock lock(tf_mutex_);
+    Extrinsics &e = extrinsics_[source];
+    ros::WallTime now = ros::WallTime::now();
+    if (e.frameId == frameId &&
+	    (tfRefresh_ <= 0 || (now - e.lookup).toSec() < tfRefresh_)) {
+	memcpy(m, e.m, sizeof(e.m));
+	return true;
+    }
+
+    geometry_msgs::TransformStamped t;
+    try {
+	t = tfBuffer_.lookupTransform(frameId_, frameId, ros::Time(0));
+    } catch (tf2::TransformException &ex) {
+	ROS_WARN_STREAM_THROTTLE(5, "No transform from " << frameId << " to " <<
+				 frameId_ << ": " << ex.what());
+	// Keep using the last known extrinsics of this frame
+	if (e.frameId != frameId)
+	    return false;
+	memcpy(m, e.m, sizeof(e.m));
+	return true;
+    }
+
+    const double x = t.transform.rotation.x, y = t.transform.rotation.y,
+	    z = t.transform.rotation.z, w = t.transform.rotation.w;
+    e.m[0] = 1 - 2*(y*y + z*z);
+    e.m[1] = 2*(x*y - z*w);
+    e.m[2] = 2*(x*z + y*w);
+    e.m[3] = t.transform.translation.x;
+    e.m[4] = 2*(x*y + z*w);
+    e.m[5] = 1 - 2*(x*x + z*z);
+    e.m[6] = 2*(y*z - x*w);
+    e.m[7] = t.transform.translation.y;
+    e.m[8] = 2*(x*z - y*w);
+    e.m[9] = 2*(y*z + x*w);
+    e.m[10] = 1 - 2*(x*x + y*y);
+    e.m[11] = t.transform.translation.z;
+    e.frameId = frameId;
+    e.lookup = now;
+    memcpy(m, e.m, sizeof(e.m));
+    return true;
+}
+
+void CloudFusion::transformPoints(uint8_t *data, size_t count, size_t pointStep,
+				  size_t xOffset, const float *m)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    uint8_t *p = data + xOffset;
+    size_t i = 0;
+    // Blocks of four points, gathered into lanes so the compiler can keep
+    // the matrix in registers and use SIMD for the arithmetic
+    for (; i + 4 <= count; i += 4, p += 4*pointStep) {
+	float x[4], y[4], z[4], rx[4], ry[4], rz[4];
+	for (int k = 0; k < 4; k++) {
+	    float v[3];
+	    memcpy(v, p + k*pointStep, sizeof(v));
+	    x[k] = v[0]; y[k] = v[1]; z[k] = v[2];
+	}
+	for (int k = 0; k < 4; k++) {
+	    bool valid = x[k] != 0 || y[k] != 0 || z[k] != 0;
+	    rx[k] = valid ? m[0]*x[k] + m[1]*y[k] + m[2]*z[k] + m[3] : nan;
+	    ry[k] = valid ? m[4]*x[k] + m[5]*y[k] + m[6]*z[k] + m[7] : nan;
+	    rz[k] = valid ? m[8]*x[k] + m[9]*y[k] + m[10]*z[k] + m[11] : nan;
+	}
+	for (int k = 0; k < 4; k++) {
+	    float v[3] = { rx[k], ry[k], rz[k] };
+	    memcpy(p + k*pointStep, v, sizeof(v));
+	}
+    }
+    for (; i < count; i++, p += pointStep) {
+	float v[3];
+	memcpy(v, p, sizeof(v));
+	bool valid = v[0] != 0 || v[1] != 0 || v[2] != 0;
+	float r[3] = { m[0]*v[0] + m[1]*v[1] + m[2]*v[2] + m[3],
+		       m[4]*v[0] + m[5]*v[1] + m[6]*v[2] + m[7],
+		       m[8]*v[0] + m[9]*v[1] + m[10]*v[2] + m[11] };
+	if (!valid)
+	    r[0] = r[1] = r[2] = nan;
+	memcpy(p, r, sizeof(r));
+    }
+}
+
+static int findField(const sensor_msgs::PointCloud2 &cloud, const std::string &name)
+{
+    for (size_t i = 0; i < cloud.fields.size(); i++)
+	if (cloud.fields[i].name == name &&
+		cloud.fields[i].datatype == sensor_msgs::PointField::FLOAT32)
+	    return cloud.fields[i].offset;
+    return -1;
+}
+
+void CloudFusion::fuse(std::vector<sensor_msgs::PointCloud2ConstPtr> &group)
+{
+    // All clouds must share the layout of the first one
+    sensor_msgs::PointCloud2ConstPtr layout;
+    ros::Time oldest, newest;
+    size_t points = 0;
+    for (size_t i = 0; i < group.size(); i++) {
+	if (!group[i])
+	    continue;
+	const sensor_msgs::PointCloud2 &cloud = *group[i];
+	if (!layout) {
+	    layout = group[i];
+	    oldest = newest = cloud.header.stamp;
+	}
+	if (cloud.point_step != layout->point_step ||
+		cloud.fields.size() != layout->fields.size()) {
+	    ROS_WARN_STREAM_THROTTLE(5, "Cloud " << cloud.header.frame_id <<
+				     " has a different layout, not fused");
+	    group[i].reset();
+	    continue;
+	}
+	if (cloud.header.stamp < oldest)
+	    oldest = cloud.header.stamp;
+	if (cloud.header.stamp > newest)
+	    newest = cloud.header.stamp;
+	points += cloud.width * cloud.height;
+    }
+    if (!layout)
+	return;
+    int x = findField(*layout, "x");
+    if (x < 0 || findField(*layout, "y") != x + 4 || findField(*layout, "z") != x + 8) {
+	ROS_WARN_STREAM_THROTTLE(5, "Clouds without consecutive float32 x, y, z fields can not be fused");
+	return;
+    }
+
+    sensor_msgs::PointCloud2Ptr merged;
+    {
+	boost::mutex::scoped_lock lock(pool_mutex_);
+	if (!merged_ || !merged_.unique())
+	    merged_.reset(new sensor_msgs::PointCloud2);
+	merged = merged_;
+    }
+    merged->header.stamp = newest;
+    merged->header.frame_id = frameId_;
+    merged->fields = layout->fields;
+    merged->is_bigendian = layout->is_bigendian;
+    merged->point_step = layout->point_step;
+    merged->height = 1;
+    merged->is_dense = false;
+    merged->data.resize(points * layout->point_step);
+
+    size_t width = 0;
+    for (size_t i = 0; i < group.size(); i++) {
+	if (!group[i])
+	    continue;
+	const sensor_msgs::PointCloud2 &cloud = *group[i];
+	float m[12];
+	if (!lookupExtrinsics(i, cloud.header.frame_id, m)) {
+	    boost::mutex::scoped_lock lock(mutex_);
+	    stats_.dropped++;
+	    continue;
+	}
+	size_t count = cloud.width * cloud.height;
+	uint8_t *out = &merged->data[width * merged->point_step];
+	memcpy(out, &cloud.data[0], count * cloud.point_step);
+	transformPoints(out, count, merged->point_step, x, m);
+	width += count;
+    }
+    if (width == 0)
+	return;
+    merged->width = width;
+    merged->row_step = width * merged->point_step;
+    merged->data.resize(merged->row_step);
+    pub_.publish(merged);
+
+    double latency = (ros::Time::now() - newest).toSec();
+    double skew = (newest - oldest).toSec();
+    boost::mutex::scoped_lock lock(mutex_);
+    stats_.fused++;
+    stats_.latency += latency;
+    stats_.maxLatency = std::max(stats_.maxLatency, latency);
+    stats_.skew += skew;
+    stats_.maxSkew = std::max(stats_.maxSkew, skew);
+}
+
+}
@@ -0,0 +1,195 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/command_executor.hpp>
+
+#include <string.h>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+namespace bta_tof_driver {
+
+CommandExecutor::CommandExecutor(double budget) :
+    budget_(budget),
+    running_(true)
+{
+    memset(&stats_, 0, sizeof(stats_));
+    thread_ = boost::thread(boost::bind(&CommandExecutor::run, this));
+}
+
+CommandExecutor::~CommandExecutor()
+{
+    {
+	boost::mutex::scoped_lock lock(mutex_);
+	running_ = false;
+	for (size_t i = 0; i < queue_.size(); i++) {
+	    queue_[i]->done = true;
+	    queue_[i]->ran = false;
+	}
+	queue_.clear();
+    }
+    queue_cond_.notify_all();
+    done_cond_.notify_all();
+    thread_.join();
+}
+
+void CommandExecutor::getStats(Stats &stats)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    stats = stats_;
+    if (stats.executed > 0) {
+	stats.wait /= stats.executed;
+	stats.run /= stats.executed;
+    }
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+CommandExecutor::JobPtr CommandExecutor::enqueue(const std::string &name, const Command &command,
+						  bool waited)
+{
+    JobPtr job(new Job);
+    job->name = name;
+    job->command = command;
+    job->queued = ros::WallTime::now();
+    job->waited = waited;
+    job->started = job->done = job->ran = false;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!running_) {
+	job->done = true;
+	return job;
+    }
+    for (size_t i = 0; i < queue_.size(); i++) {
+	// Somebody waits for the result of an execute, a post must not drop it
+	if (queue_[i]->name == name && (waited || !queue_[i]->waited)) {
+	    queue_[i]->done = true;
+	    stats_.superseded++;
+	    queue_[i] = job;
+	    done_cond_.notify_all();
+	    return job;
+	}
+    }
+    queue_.push_back(job);
+    queue_cond_.notify_one();
+    return job;
+}
+
+void CommandExecutor::post(const std::string &name, const Command &command)
+{
+    enqueue(name, command, false);
+}
+
+bool CommandExecutor::execute(const std::string &name, const Command &command)
+{
+    JobPtr job = enqueue(name, command, true);
+    boost::system_time deadline = boost::get_system_time() +
+	boost::posix_time::microseconds((int64_t)(budget_*1e6));
+
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!job->done && (job->started || boost::get_system_time() < deadline)) {
+	if (job->started)
+	    done_cond_.wait(lock);
+	else
+	    done_cond_.timed_wait(lock, deadline);
+    }
+    if (!job->done) {
+	// Did not start in time, make sure it never does
+	std::deque<JobPtr>::iterator it = std::find(queue_.begin(), queue_.end(), job);
+	if (it != queue_.end())
+	    queue_.erase(it);
+	job->done = true;
+	stats_.expired++;
+    }
+    return job->ran;
+}
+
+void CommandExecutor::finish(const JobPtr &job, bool ran)
+{
+    job->done = true;
+    job->ran = ran;
+    job->command.clear();
+    done_cond_.notify_all();
+}
+
+void CommandExecutor::run()
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    while (running_) {
+	if (queue_.empty()) {
+	    queue_cond_.wait(lock);
+	    continue;
+	}
+	JobPtr job = queue_.front();
+	queue_.pop_front();
+
+	double wait = (ros::WallTime::now() - job->queued).toSec();
+	if (wait > budget_) {
+	    stats_.expired++;
+	    ROS_WARN_STREAM("Dropped command " << job->name << ", it waited " <<
+			    wait << " s");
+	    finish(job, false);
+	    continue;
+	}
+
+	job->started = true;
+	lock.unlock();
+	ros::WallTime start = ros::WallTime::now();
+	job->command();
+	double run = (ros::WallTime::now() - start).toSec();
+	lock.lock();
+
+	stats_.executed++;
+	stats_.wait += wait;
+	stats_.maxWait = std::max(stats_.maxWait, wait);
+	stats_.run += run;
+	stats_.maxRun = std::max(stats_.maxRun, run);
+	if (run > budget_) {
+	    stats_.overBudget++;
+	    ROS_WARN_STREAM("Command " << job->name << " took " << run <<
+			    " s, budget is " << budget_ << " s");
+	}
+	finish(job, true);
+    }
+}
+
+}
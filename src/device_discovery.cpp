@@ -0,0 +1,230 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/device_discovery.hpp>
+
+#include <ros/console.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace bta_tof_driver
+{
+
+boost::mutex DeviceDiscovery::mutex_;
+boost::condition_variable DeviceDiscovery::found_cond_;
+std::vector<DiscoveredDevice> DeviceDiscovery::found_;
+
+DiscoveredDevice::DiscoveredDevice() :
+    deviceType(BTA_DeviceTypeGenericEth),
+    serialNumber(0),
+    tcpControlPort(0),
+    tcpDataPort(0),
+    udpDataPort(0),
+    udpControlPort(0)
+{
+}
+
+bool DiscoveredDevice::matches(uint32_t serial, const std::string &pon) const
+{
+    return (serial == 0 || serial == serialNumber) &&
+	    (pon.empty() || pon == productOrderNumber);
+}
+
+void BTA_CALLCONV DeviceDiscovery::infoEvent(BTA_Handle handle, BTA_Status status, int8_t *msg)
+{
+    ROS_DEBUG("   Discovery: infoEvent (%d) %s", status, (char *)msg);
+}
+
+void BTA_CALLCONV DeviceDiscovery::deviceFound(BTA_Handle handle, BTA_DeviceInfo *deviceInfo)
+{
+    DiscoveredDevice device;
+    device.deviceType = deviceInfo->deviceType;
+    if (deviceInfo->productOrderNumber)
+	device.productOrderNumber = (char *)deviceInfo->productOrderNumber;
+    device.serialNumber = deviceInfo->serialNumber;
+    if (deviceInfo->deviceIpAddr)
+	device.deviceIpAddr.assign(deviceInfo->deviceIpAddr,
+				   deviceInfo->deviceIpAddr + deviceInfo->deviceIpAddrLen);
+    device.tcpControlPort = deviceInfo->tcpControlPort;
+    device.tcpDataPort = deviceInfo->tcpDataPort;
+    if (deviceInfo->udpDataIpAddr)
+	device.udpDataIpAddr.assign(deviceInfo->udpDataIpAddr,
+				    deviceInfo->udpDataIpAddr + deviceInfo->udpDataIpAddrLen);
+    device.udpDataPort = deviceInfo->udpDataPort;
+    device.udpControlPort = deviceInfo->udpControlPort;
+    device.found = boost::posix_time::microsec_clock::universal_time();
+
+    ROS_DEBUG_STREAM("Discovered device " << device.productOrderNumber <<
+		     " serial " << device.serialNumber);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    for (size_t i = 0; i < found_.size(); i++) {
+	if (found_[i].serialNumber == device.serialNumber &&
+		found_[i].productOrderNumber == device.productOrderNumber) {
+	    found_[i] = device;
+	    found_cond_.notify_all();
+	    return;
+	}
+    }
+    found_.push_back(device);
+    found_cond_.notify_all();
+}
+
+bool DeviceDiscovery::discover(BTA_DeviceType deviceType, uint32_t serial,
+			       const std::string &pon, double timeout,
+			       DiscoveredDevice *device)
+{
+    BTA_DiscoveryConfig config;
+    BTAinitDiscoveryConfig(&config);
+    config.deviceType = deviceType;
+
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+    boost::posix_time::ptime deadline = start + boost::posix_time::microseconds((int64_t)(timeout*1e6));
+
+    BTA_Handle handle;
+    BTA_Status status = BTAstartDiscovery(&config, &deviceFound, &infoEvent, &handle);
+    if (status != BTA_StatusOk) {
+	ROS_WARN_STREAM("Could not start discovery. status: " << status);
+	return false;
+    }
+
+    // Several drivers may discover at the same time, so answers are shared
+    // and only those from this round are considered
+    bool ok = false;
+    {
+	boost::mutex::scoped_lock lock(mutex_);
+	while (!ok) {
+	    for (size_t i = 0; i < found_.size() && !ok; i++) {
+		if (found_[i].found >= start && found_[i].matches(serial, pon)) {
+		    *device = found_[i];
+		    ok = true;
+		}
+	    }
+	    if (!ok && !found_cond_.timed_wait(lock, deadline))
+		break;
+	}
+    }
+
+    BTAstopDiscovery(&handle);
+    return ok;
+}
+
+static std::string ipToString(const std::vector<uint8_t> &ip)
+{
+    if (ip.empty())
+	return "-";
+    std::ostringstream ss;
+    for (size_t i = 0; i < ip.size(); i++)
+	ss << (i ? "." : "") << (int)ip[i];
+    return ss.str();
+}
+
+static std::vector<uint8_t> stringToIp(const std::string &str)
+{
+    std::vector<uint8_t> ip;
+    if (str == "-")
+	return ip;
+    std::istringstream ss(str);
+    std::string part;
+    while (std::getline(ss, part, '.'))
+	ip.push_back((uint8_t)strtoul(part.c_str(), NULL, 10));
+    return ip;
+}
+
+bool DeviceDiscovery::loadCache(const std::string &fileName, uint32_t serial,
+				const std::string &pon, DiscoveredDevice *device)
+{
+    std::ifstream file(fileName.c_str());
+    if (!file)
+	return false;
+
+    DiscoveredDevice cached;
+    std::string key, value;
+    while (file >> key >> value) {
+	if (key == "deviceType")
+	    cached.deviceType = (BTA_DeviceType)strtoul(value.c_str(), NULL, 0);
+	else if (key == "productOrderNumber")
+	    cached.productOrderNumber = value == "-" ? "" : value;
+	else if (key == "serialNumber")
+	    cached.serialNumber = strtoul(value.c_str(), NULL, 0);
+	else if (key == "deviceIpAddr")
+	    cached.deviceIpAddr = stringToIp(value);
+	else if (key == "tcpControlPort")
+	    cached.tcpControlPort = strtoul(value.c_str(), NULL, 0);
+	else if (key == "tcpDataPort")
+	    cached.tcpDataPort = strtoul(value.c_str(), NULL, 0);
+	else if (key == "udpDataIpAddr")
+	    cached.udpDataIpAddr = stringToIp(value);
+	else if (key == "udpDataPort")
+	    cached.udpDataPort = strtoul(value.c_str(), NULL, 0);
+	else if (key == "udpControlPort")
+	    cached.udpControlPort = strtoul(value.c_str(), NULL, 0);
+    }
+    if (cached.deviceIpAddr.empty() || !cached.matches(serial, pon))
+	return false;
+    *device = cached;
+    return true;
+}
+
+bool DeviceDiscovery::saveCache(const std::string &fileName, const DiscoveredDevice &device)
+{
+    std::ofstream file(fileName.c_str());
+    if (!file)
+	return false;
+    file << "deviceType " << (int)device.deviceType << "\n"
+	 << "productOrderNumber " << (device.productOrderNumber.empty() ? "-" : device.productOrderNumber) << "\n"
+	 << "serialNumber " << device.serialNumber << "\n"
+	 << "deviceIpAddr " << ipToString(device.deviceIpAddr) << "\n"
+	 << "tcpControlPort " << device.tcpControlPort << "\n"
+	 << "tcpDataPort " << device.tcpDataPort << "\n"
+	 << "udpDataIpAddr " << ipToString(device.udpDataIpAddr) << "\n"
+	 << "udpDataPort " << device.udpDataPort << "\n"
+	 << "udpControlPort " << device.udpControlPort << "\n";
+    return file.good();
+}
+
+}
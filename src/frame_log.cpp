@@ -0,0 +1,287 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/frame_log.hpp>
+
+#include <lz4.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace bta_tof_driver
+{
+
+static const char frameLogMagic[8] = {'B','T','A','F','L','O','G','1'};
+
+static std::string segmentName(const std::string &base, uint32_t segment)
+{
+    std::ostringstream name;
+    name << base << "." << std::setw(5) << std::setfill('0') << segment << ".lz4";
+    return name.str();
+}
+
+static void *mapFile(const std::string &name, size_t *length)
+{
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    struct stat st;
+    void *map = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	    map = NULL;
+	else
+	    *length = st.st_size;
+    }
+    ::close(fd);
+    return map;
+}
+
+FrameLogWriter::FrameLogWriter(const std::string &base, uint64_t segmentSize) :
+    base_(base),
+    segmentSize_(segmentSize),
+    index_(NULL),
+    data_(NULL),
+    segment_(0),
+    offset_(0),
+    count_(0)
+{
+    index_ = fopen((base_ + ".idx").c_str(), "wb");
+    if (!index_)
+	return;
+    FrameLogIndexHeader header;
+    memcpy(header.magic, frameLogMagic, sizeof(header.magic));
+    header.version = 1;
+    header.entrySize = sizeof(FrameLogIndexEntry);
+    if (fwrite(&header, sizeof(header), 1, index_) != 1 || !openSegment(0))
+	close();
+}
+
+FrameLogWriter::~FrameLogWriter()
+{
+    close();
+}
+
+void FrameLogWriter::close()
+{
+    if (data_)
+	fclose(data_);
+    if (index_)
+	fclose(index_);
+    data_ = index_ = NULL;
+}
+
+bool FrameLogWriter::openSegment(uint32_t segment)
+{
+    if (data_)
+	fclose(data_);
+    data_ = fopen(segmentName(base_, segment).c_str(), "wb");
+    segment_ = segment;
+    offset_ = 0;
+    return data_ != NULL;
+}
+
+bool FrameLogWriter::append(BTA_Frame *frame)
+{
+    if (!index_ || !data_)
+	return false;
+
+    uint32_t serializedLen;
+    if (BTAgetSerializedLength(frame, &serializedLen) != BTA_StatusOk)
+	return false;
+    serialized_.resize(serializedLen);
+    if (BTAserializeFrame(frame, &serialized_[0], &serializedLen) != BTA_StatusOk)
+	return false;
+
+    compressed_.resize(LZ4_compressBound(serializedLen));
+    int compressedLen = LZ4_compress_default((const char *)&serialized_[0],
+					     (char *)&compressed_[0],
+					     serializedLen, compressed_.size());
+    if (compressedLen <= 0)
+	return false;
+
+    if (offset_ > 0 && offset_ + compressedLen > segmentSize_) {
+	if (!openSegment(segment_ + 1))
+	    return false;
+    }
+
+    // Data goes first so that the index never points past the segment end.
+    // Part of a failed write may have reached the file, so offset_ would
+    // no longer match: continue in a new segment
+    if (fwrite(&compressed_[0], compressedLen, 1, data_) != 1 || fflush(data_) != 0) {
+	openSegment(segment_ + 1);
+	return false;
+    }
+
+    FrameLogIndexEntry entry;
+    entry.frameCounter = frame->frameCounter;
+    entry.timeStamp = frame->timeStamp;
+    entry.segment = segment_;
+    entry.compressedSize = compressedLen;
+    entry.offset = offset_;
+    entry.serializedSize = serializedLen;
+    entry.reserved = 0;
+    // A partial entry would shift all later ones. Stop instead, readers
+    // ignore an incomplete last entry
+    if (fwrite(&entry, sizeof(entry), 1, index_) != 1 || fflush(index_) != 0) {
+	close();
+	return false;
+    }
+
+    offset_ += compressedLen;
+    count_++;
+    return true;
+}
+
+FrameLogReader::FrameLogReader(const std::string &base) :
+    base_(base),
+    indexMap_(NULL),
+    indexLength_(0),
+    entries_(NULL),
+    count_(0)
+{
+    indexMap_ = mapFile(base_ + ".idx", &indexLength_);
+    if (!indexMap_)
+	return;
+    const FrameLogIndexHeader *header = (const FrameLogIndexHeader *)indexMap_;
+    if (indexLength_ < sizeof(FrameLogIndexHeader) ||
+	    memcmp(header->magic, frameLogMagic, sizeof(header->magic)) != 0 ||
+	    header->entrySize != sizeof(FrameLogIndexEntry)) {
+	munmap(indexMap_, indexLength_);
+	indexMap_ = NULL;
+	return;
+    }
+    entries_ = (const FrameLogIndexEntry *)((const uint8_t *)indexMap_ + sizeof(FrameLogIndexHeader));
+    count_ = (indexLength_ - sizeof(FrameLogIndexHeader)) / sizeof(FrameLogIndexEntry);
+}
+
+FrameLogReader::~FrameLogReader()
+{
+    for (size_t i = 0; i < segments_.size(); i++) {
+	if (segments_[i].first)
+	    munmap(segments_[i].first, segments_[i].second);
+    }
+    if (indexMap_)
+	munmap(indexMap_, indexLength_);
+}
+
+const uint8_t *FrameLogReader::mapSegment(uint32_t segment, size_t *length)
+{
+    boost::mutex::scoped_lock lock(segments_mutex_);
+    if (segment >= segments_.size())
+	segments_.resize(segment + 1, std::make_pair((void *)NULL, (size_t)0));
+    if (!segments_[segment].first) {
+	size_t len = 0;
+	void *map = mapFile(segmentName(base_, segment), &len);
+	if (!map)
+	    return NULL;
+	segments_[segment] = std::make_pair(map, len);
+    }
+    *length = segments_[segment].second;
+    return (const uint8_t *)segments_[segment].first;
+}
+
+BTA_Status FrameLogReader::readFrame(size_t i, BTA_Frame **frame)
+{
+    if (i >= count_)
+	return BTA_StatusInvalidParameter;
+    const FrameLogIndexEntry &e = entries_[i];
+    size_t length;
+    const uint8_t *data = mapSegment(e.segment, &length);
+    if (!data || e.offset + e.compressedSize > length)
+	return BTA_StatusRuntimeError;
+
+    std::vector<uint8_t> serialized(e.serializedSize);
+    int len = LZ4_decompress_safe((const char *)data + e.offset,
+				  (char *)&serialized[0],
+				  e.compressedSize, e.serializedSize);
+    if (len < 0 || (uint32_t)len != e.serializedSize)
+	return BTA_StatusCrcError;
+
+    uint32_t serializedLen = e.serializedSize;
+    return BTAdeserializeFrame(frame, &serialized[0], &serializedLen);
+}
+
+static bool timeStampLess(const FrameLogIndexEntry &e, uint32_t timeStamp)
+{
+    return e.timeStamp < timeStamp;
+}
+
+size_t FrameLogReader::findTimeStamp(uint32_t timeStamp) const
+{
+    return std::lower_bound(entries_, entries_ + count_, timeStamp, timeStampLess) - entries_;
+}
+
+static void decodeWorker(FrameLogReader *reader, size_t begin, size_t end,
+			 size_t stride, FrameLogReader::FrameCallback callback)
+{
+    for (size_t i = begin; i < end; i += stride) {
+	BTA_Frame *frame;
+	if (reader->readFrame(i, &frame) == BTA_StatusOk)
+	    callback(i, frame);
+    }
+}
+
+void FrameLogReader::decodeParallel(size_t begin, size_t end, unsigned threadCount,
+				    FrameCallback callback)
+{
+    end = std::min(end, count_);
+    if (threadCount == 0)
+	threadCount = std::max(1u, boost::thread::hardware_concurrency());
+    // Interleave frames so every thread walks the segments in order
+    boost::thread_group workers;
+    for (unsigned t = 0; t < threadCount && begin + t < end; t++)
+	workers.create_thread(boost::bind(&decodeWorker, this, begin + t, end,
+					  threadCount, callback));
+    workers.join_all();
+}
+
+}
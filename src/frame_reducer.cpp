@@ -0,0 +1,240 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/frame_reducer.hpp>
+
+#include <string.h>
+#include <algorithm>
+
+namespace bta_tof_driver {
+
+// Largest binning, a block holds at most maxBinning^2 pixels
+static const uint32_t maxBinning = 4;
+
+FrameReducer::FrameReducer(const Settings &settings) :
+    settings_(settings)
+{
+    settings_.binning = std::max(1u, std::min(settings_.binning, maxBinning));
+}
+
+FrameReducer::Region FrameReducer::region(uint16_t width, uint16_t height) const
+{
+    uint32_t b = settings_.binning;
+    Region r;
+    r.x = std::min<uint32_t>(settings_.x, width);
+    r.y = std::min<uint32_t>(settings_.y, height);
+    r.width = settings_.width ? std::min<uint32_t>(settings_.width, width - r.x) : width - r.x;
+    r.height = settings_.height ? std::min<uint32_t>(settings_.height, height - r.y) : height - r.y;
+    r.width -= r.width % b;
+    r.height -= r.height % b;
+    return r;
+}
+
+template <typename T>
+static T blockMean(const T *values, size_t count)
+{
+    double sum = 0;
+    for (size_t i = 0; i < count; i++)
+	sum += values[i];
+    return sum/count;
+}
+
+template <>
+uint16_t blockMean(const uint16_t *values, size_t count)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+	sum += values[i];
+    return (sum + count/2)/count;
+}
+
+template <typename T>
+static void reduceBlocks(const T *in, uint16_t inWidth, uint32_t x0, uint32_t y0,
+			 uint32_t width, uint32_t height, uint32_t b, bool median,
+			 bool invalidAware, T *out)
+{
+    if (b == 1) {
+	for (uint32_t y = 0; y < height; y++)
+	    memcpy(out + y*width, in + (y0 + y)*inWidth + x0, width*sizeof(T));
+	return;
+    }
+    T values[maxBinning*maxBinning];
+    for (uint32_t y = 0; y < height; y++) {
+	for (uint32_t x = 0; x < width; x++) {
+	    size_t n = 0;
+	    const T *block = in + (y0 + y*b)*inWidth + x0 + x*b;
+	    for (uint32_t dy = 0; dy < b; dy++, block += inWidth)
+		for (uint32_t dx = 0; dx < b; dx++)
+		    if (!invalidAware || block[dx] != 0)
+			values[n++] = block[dx];
+	    if (n == 0) {
+		*out++ = 0;
+	    } else if (median) {
+		std::nth_element(values, values + n/2, values + n);
+		*out++ = values[n/2];
+	    } else {
+		*out++ = blockMean(values, n);
+	    }
+	}
+    }
+}
+
+template <typename T>
+static void reducePointBlocks(const T *inX, const T *inY, const T *inZ, uint16_t inWidth,
+			      uint32_t x0, uint32_t y0, uint32_t width, uint32_t height,
+			      uint32_t b, bool median, T *outX, T *outY, T *outZ)
+{
+    // Offsets of the valid points of a block, the median is the point of
+    // median depth so that it stays a measured one
+    size_t valid[maxBinning*maxBinning];
+    T values[maxBinning*maxBinning];
+    for (uint32_t y = 0; y < height; y++) {
+	for (uint32_t x = 0; x < width; x++, outX++, outY++, outZ++) {
+	    size_t n = 0;
+	    size_t first = (y0 + y*b)*inWidth + x0 + x*b;
+	    for (uint32_t dy = 0; dy < b; dy++)
+		for (uint32_t dx = 0; dx < b; dx++) {
+		    size_t i = first + dy*inWidth + dx;
+		    if (inX[i] != 0 || inY[i] != 0 || inZ[i] != 0)
+			valid[n++] = i;
+		}
+	    if (n == 0) {
+		*outX = *outY = *outZ = 0;
+	    } else if (median) {
+		for (size_t k = 0; k < n; k++)
+		    values[k] = inZ[valid[k]];
+		std::nth_element(values, values + n/2, values + n);
+		size_t k = 0;
+		while (inZ[valid[k]] != values[n/2])
+		    k++;
+		*outX = inX[valid[k]];
+		*outY = inY[valid[k]];
+		*outZ = inZ[valid[k]];
+	    } else {
+		double sx = 0, sy = 0, sz = 0;
+		for (size_t k = 0; k < n; k++) {
+		    sx += inX[valid[k]];
+		    sy += inY[valid[k]];
+		    sz += inZ[valid[k]];
+		}
+		*outX = sx/n;
+		*outY = sy/n;
+		*outZ = sz/n;
+	    }
+	}
+    }
+}
+
+void *FrameReducer::reduce(Channel channel, void *data, BTA_DataFormat format,
+			   uint16_t &width, uint16_t &height)
+{
+    Region r = region(width, height);
+    uint32_t b = settings_.binning;
+    uint32_t outWidth = r.width/b, outHeight = r.height/b;
+    if (outWidth == 0 || outHeight == 0)
+	return data;
+    bool invalidAware = channel == Distances;
+    std::vector<uint8_t> &buffer = buffers_[channel];
+    if (format == BTA_DataFormatUInt16) {
+	buffer.resize(outWidth*outHeight*sizeof(uint16_t));
+	reduceBlocks(static_cast<const uint16_t *>(data), width, r.x, r.y, outWidth, outHeight,
+		     b, settings_.median, invalidAware, (uint16_t *)&buffer[0]);
+    } else if (format == BTA_DataFormatFloat32) {
+	buffer.resize(outWidth*outHeight*sizeof(float));
+	reduceBlocks(static_cast<const float *>(data), width, r.x, r.y, outWidth, outHeight,
+		     b, settings_.median, invalidAware, (float *)&buffer[0]);
+    } else {
+	return data;
+    }
+    width = outWidth;
+    height = outHeight;
+    return &buffer[0];
+}
+
+void FrameReducer::reducePoints(void *&x, void *&y, void *&z, BTA_DataFormat format,
+				uint16_t &width, uint16_t &height)
+{
+    Region r = region(width, height);
+    uint32_t b = settings_.binning;
+    uint32_t outWidth = r.width/b, outHeight = r.height/b;
+    if (outWidth == 0 || outHeight == 0)
+	return;
+    size_t size;
+    if (format == BTA_DataFormatSInt16)
+	size = sizeof(int16_t);
+    else if (format == BTA_DataFormatFloat32)
+	size = sizeof(float);
+    else
+	return;
+    for (int i = 0; i < 3; i++)
+	points_[i].resize(outWidth*outHeight*size);
+    if (format == BTA_DataFormatSInt16)
+	reducePointBlocks(static_cast<const int16_t *>(x), static_cast<const int16_t *>(y),
+			  static_cast<const int16_t *>(z), width, r.x, r.y, outWidth, outHeight,
+			  b, settings_.median, (int16_t *)&points_[0][0],
+			  (int16_t *)&points_[1][0], (int16_t *)&points_[2][0]);
+    else
+	reducePointBlocks(static_cast<const float *>(x), static_cast<const float *>(y),
+			  static_cast<const float *>(z), width, r.x, r.y, outWidth, outHeight,
+			  b, settings_.median, (float *)&points_[0][0],
+			  (float *)&points_[1][0], (float *)&points_[2][0]);
+    x = &points_[0][0];
+    y = &points_[1][0];
+    z = &points_[2][0];
+    width = outWidth;
+    height = outHeight;
+}
+
+void FrameReducer::adjust(sensor_msgs::CameraInfo &info, uint16_t width, uint16_t height) const
+{
+    Region r = region(width, height);
+    if (r.x != 0 || r.y != 0 || r.width != width || r.height != height) {
+	info.roi.x_offset = r.x;
+	info.roi.y_offset = r.y;
+	info.roi.width = r.width;
+	info.roi.height = r.height;
+    }
+    info.binning_x = settings_.binning;
+    info.binning_y = settings_.binning;
+}
+
+}
@@ -0,0 +1,172 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/frame_sync.hpp>
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+namespace bta_tof_driver {
+
+FrameSync::FrameSync(ros::NodeHandle nh, const DemandChangedCallback &demandChanged) :
+    nh_(nh),
+    ringSize_(8),
+    maxOffset_(0.05),
+    offset_(0.0),
+    gstImages_(false)
+{
+    int ringSize = ringSize_;
+    nh_.getParam("ringSize", ringSize);
+    ringSize_ = std::max(ringSize, 1);
+    nh_.getParam("maxOffset", maxOffset_);
+    nh_.getParam("offset", offset_);
+    nh_.getParam("gstImages", gstImages_);
+    memset(&stats_, 0, sizeof(stats_));
+
+    ros::SubscriberStatusCallback update;
+    if (demandChanged)
+	update = boost::bind(demandChanged);
+    pub_distances_ = nh_.advertise<sensor_msgs::Image>("distances", 1, update, update);
+    if (gstImages_)
+	pub_image_ = nh_.advertise<GstImage>("image_raw", 1, update, update);
+    else
+	pub_image_ = nh_.advertise<sensor_msgs::Image>("image_raw", 1, update, update);
+}
+
+FrameSync::~FrameSync()
+{
+}
+
+bool FrameSync::isSubscribed() const
+{
+    return pub_distances_.getNumSubscribers() > 0 ||
+	pub_image_.getNumSubscribers() > 0;
+}
+
+void FrameSync::getStats(Stats &stats)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    stats = stats_;
+    if (stats.paired > 0)
+	stats.offset /= stats.paired;
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+void FrameSync::addImage(const GstImageConstPtr &image)
+{
+    std::vector<Pair> pairs;
+    {
+	boost::mutex::scoped_lock lock(mutex_);
+	images_.push_back(image);
+	if (images_.size() > ringSize_)
+	    images_.pop_front();
+	match(pairs);
+    }
+    publish(pairs);
+}
+
+void FrameSync::addDistances(const sensor_msgs::ImageConstPtr &distances)
+{
+    std::vector<Pair> pairs;
+    {
+	boost::mutex::scoped_lock lock(mutex_);
+	pending_.push_back(distances);
+	// Without 2D images nothing can be paired, give up on the oldest
+	if (pending_.size() > ringSize_) {
+	    pending_.pop_front();
+	    stats_.unmatched++;
+	}
+	match(pairs);
+    }
+    publish(pairs);
+}
+
+void FrameSync::publish(const std::vector<Pair> &pairs)
+{
+    for (size_t i = 0; i < pairs.size(); i++) {
+	pub_distances_.publish(pairs[i].first);
+	if (gstImages_) {
+	    // The pixels stay in the 2D message, only the header is new
+	    GstImagePtr image = pairs[i].second->share();
+	    image->header.stamp = pairs[i].first->header.stamp;
+	    pub_image_.publish(image);
+	} else if (pub_image_.getNumSubscribers() > 0) {
+	    sensor_msgs::ImagePtr image = pairs[i].second->copy();
+	    image->header.stamp = pairs[i].first->header.stamp;
+	    pub_image_.publish(image);
+	}
+    }
+}
+
+void FrameSync::match(std::vector<Pair> &pairs)
+{
+    while (!pending_.empty() && !images_.empty()) {
+	double stamp = pending_.front()->header.stamp.toSec();
+	// Wait for a newer 2D image, it might be closer than the ones we have
+	if (images_.back()->header.stamp.toSec() + offset_ < stamp)
+	    break;
+
+	size_t best = 0;
+	double bestOffset = -1;
+	for (size_t i = 0; i < images_.size(); i++) {
+	    double offset = fabs(images_[i]->header.stamp.toSec() + offset_ - stamp);
+	    if (bestOffset < 0 || offset < bestOffset) {
+		best = i;
+		bestOffset = offset;
+	    }
+	}
+	if (bestOffset <= maxOffset_) {
+	    pairs.push_back(Pair(pending_.front(), images_[best]));
+	    stats_.paired++;
+	    stats_.offset += bestOffset;
+	    stats_.maxOffset = std::max(stats_.maxOffset, bestOffset);
+	} else {
+	    stats_.unmatched++;
+	}
+	pending_.pop_front();
+    }
+}
+
+}
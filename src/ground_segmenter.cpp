@@ -0,0 +1,293 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/ground_segmenter.hpp>
+#include <sensor_msgs/point_cloud2_iterator.h>
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace bta_tof_driver {
+
+// Confidence of having drawn one sample of inliers only
+static const double confidence = 0.99;
+// Share of the inliers of the last full fit the previous plane has to keep
+// to be reused
+static const double seedShare = 0.95;
+
+GroundSegmenter::GroundSegmenter(const Settings &settings) :
+    settings_(settings),
+    width_(0),
+    height_(0),
+    hasPlane_(false),
+    fitInliers_(0),
+    random_(2463534242u)
+{
+    settings_.stride = std::max(settings_.stride, 1);
+    // z of the z-up frame in the cloud frame: last row of R = Rz*Ry*Rx, the
+    // convention of the published extrinsics
+    std::vector<double> e = settings_.extrinsics;
+    e.resize(6, 0.0);
+    up_[0] = -sin(e[4]);
+    up_[1] = cos(e[4])*sin(e[3]);
+    up_[2] = cos(e[4])*cos(e[3]);
+    minCos_ = cos(settings_.maxAngle);
+    memset(plane_, 0, sizeof(plane_));
+}
+
+float *GroundSegmenter::points(uint16_t width, uint16_t height)
+{
+    width_ = width;
+    height_ = height;
+    points_.resize(3*width*height);
+    return &points_[0];
+}
+
+uint32_t GroundSegmenter::random()
+{
+    random_ ^= random_ << 13;
+    random_ ^= random_ >> 17;
+    random_ ^= random_ << 5;
+    return random_;
+}
+
+inline bool GroundSegmenter::valid(size_t i) const
+{
+    const float *p = &points_[3*i];
+    return p[0] != 0 || p[1] != 0 || p[2] != 0;
+}
+
+bool GroundSegmenter::planeOf(size_t a, size_t b, size_t c, float plane[4]) const
+{
+    const float *p = &points_[3*a], *q = &points_[3*b], *r = &points_[3*c];
+    float u[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+    float v[3] = { r[0] - p[0], r[1] - p[1], r[2] - p[2] };
+    float n[3] = { u[1]*v[2] - u[2]*v[1], u[2]*v[0] - u[0]*v[2], u[0]*v[1] - u[1]*v[0] };
+    float norm = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if (!(norm > 1e-9))
+	return false;
+    float cosine = (n[0]*up_[0] + n[1]*up_[1] + n[2]*up_[2])/norm;
+    // Normal pointing up
+    if (cosine < 0) {
+	norm = -norm;
+	cosine = -cosine;
+    }
+    if (cosine < minCos_)
+	return false;
+    plane[0] = n[0]/norm;
+    plane[1] = n[1]/norm;
+    plane[2] = n[2]/norm;
+    plane[3] = -(plane[0]*p[0] + plane[1]*p[1] + plane[2]*p[2]);
+    return true;
+}
+
+uint32_t GroundSegmenter::score(const float plane[4]) const
+{
+    uint32_t inliers = 0;
+    float distance = settings_.distance;
+    for (uint32_t y = 0; y < height_; y += settings_.stride) {
+	const float *p = &points_[3*y*width_];
+	for (uint32_t x = 0; x < width_; x += settings_.stride, p += 3*settings_.stride) {
+	    // Invalid points sit at the origin, d away from the plane
+	    float d = plane[0]*p[0] + plane[1]*p[1] + plane[2]*p[2] + plane[3];
+	    inliers += fabs(d) < distance && (p[0] != 0 || p[1] != 0 || p[2] != 0);
+	}
+    }
+    return inliers;
+}
+
+void GroundSegmenter::refine(float plane[4]) const
+{
+    // Centroid and covariance of the sampled inliers
+    double n = 0, c[3] = { 0, 0, 0 }, m[6] = { 0, 0, 0, 0, 0, 0 };
+    for (uint32_t y = 0; y < height_; y += settings_.stride) {
+	const float *p = &points_[3*y*width_];
+	for (uint32_t x = 0; x < width_; x += settings_.stride, p += 3*settings_.stride) {
+	    float d = plane[0]*p[0] + plane[1]*p[1] + plane[2]*p[2] + plane[3];
+	    if (!(fabs(d) < settings_.distance) || (p[0] == 0 && p[1] == 0 && p[2] == 0))
+		continue;
+	    n++;
+	    c[0] += p[0]; c[1] += p[1]; c[2] += p[2];
+	    m[0] += p[0]*p[0]; m[1] += p[0]*p[1]; m[2] += p[0]*p[2];
+	    m[3] += p[1]*p[1]; m[4] += p[1]*p[2]; m[5] += p[2]*p[2];
+	}
+    }
+    if (n < 3)
+	return;
+    for (int i = 0; i < 3; i++)
+	c[i] /= n;
+    double a = m[0]/n - c[0]*c[0], b = m[1]/n - c[0]*c[1], e = m[2]/n - c[0]*c[2];
+    double f = m[3]/n - c[1]*c[1], g = m[4]/n - c[1]*c[2], h = m[5]/n - c[2]*c[2];
+    // Normal is the eigenvector of the smallest eigenvalue, found by
+    // inverse iteration from the current normal with the adjugate
+    double adj[9] = { f*h - g*g, e*g - b*h, b*g - e*f,
+		      e*g - b*h, a*h - e*e, b*e - a*g,
+		      b*g - e*f, b*e - a*g, a*f - b*b };
+    double v[3] = { plane[0], plane[1], plane[2] };
+    for (int k = 0; k < 3; k++) {
+	double w[3];
+	for (int i = 0; i < 3; i++)
+	    w[i] = adj[3*i]*v[0] + adj[3*i + 1]*v[1] + adj[3*i + 2]*v[2];
+	double norm = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+	if (!(norm > 0))
+	    return;
+	for (int i = 0; i < 3; i++)
+	    v[i] = w[i]/norm;
+    }
+    if (v[0]*plane[0] + v[1]*plane[1] + v[2]*plane[2] < 0)
+	for (int i = 0; i < 3; i++)
+	    v[i] = -v[i];
+    if (v[0]*up_[0] + v[1]*up_[1] + v[2]*up_[2] < minCos_)
+	return;
+    for (int i = 0; i < 3; i++)
+	plane[i] = v[i];
+    plane[3] = -(v[0]*c[0] + v[1]*c[1] + v[2]*c[2]);
+}
+
+void GroundSegmenter::segment(GroundPlane &plane)
+{
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(settings_.budget);
+    float best[4];
+    uint32_t bestInliers = 0, iterations = 0;
+    bool seeded = false;
+
+    if (hasPlane_ && minCos_ <= plane_[0]*up_[0] + plane_[1]*up_[1] + plane_[2]*up_[2]) {
+	memcpy(best, plane_, sizeof(best));
+	bestInliers = score(plane_);
+	seeded = true;
+    }
+
+    uint32_t sampled = 0;
+    for (uint32_t y = 0; y < height_; y += settings_.stride)
+	for (uint32_t x = 0; x < width_; x += settings_.stride)
+	    sampled += valid(y*width_ + x);
+
+    // Triangles spanning an eighth of the image
+    int dx = std::max(width_/8, 1), dy = std::max(height_/8, 1);
+    // Compared with the last sampled fit, not the last seed, so that a
+    // plane losing a few inliers per frame does not get reused forever
+    bool stable = seeded && bestInliers >= seedShare*fitInliers_;
+    while (!stable && sampled > 0 && width_ > dx && height_ > dy &&
+	   iterations < (uint32_t)settings_.maxIterations) {
+	if (bestInliers > 0) {
+	    double w = (double)bestInliers/sampled;
+	    double w3 = w*w*w;
+	    if (w3 >= 1 || iterations >= log(1 - confidence)/log(1 - w3))
+		break;
+	}
+	if (ros::WallTime::now() > deadline)
+	    break;
+	iterations++;
+
+	int x = random() % width_, y = random() % height_;
+	int x2 = x + dx < width_ ? x + dx : x - dx;
+	int y2 = y + dy < height_ ? y + dy : y - dy;
+	size_t a = y*width_ + x, b = y*width_ + x2, c = y2*width_ + x;
+	float candidate[4];
+	if (!valid(a) || !valid(b) || !valid(c) || !planeOf(a, b, c, candidate))
+	    continue;
+	uint32_t inliers = score(candidate);
+	if (inliers > bestInliers) {
+	    memcpy(best, candidate, sizeof(best));
+	    bestInliers = inliers;
+	    seeded = false;
+	}
+    }
+
+    hasPlane_ = bestInliers > 0;
+    if (hasPlane_) {
+	refine(best);
+	memcpy(plane_, best, sizeof(plane_));
+    }
+    if (!stable || !hasPlane_)
+	fitInliers_ = bestInliers;
+
+    for (int i = 0; i < 4; i++)
+	plane.coefficients[i] = hasPlane_ ? plane_[i] : 0;
+    plane.valid = hasPlane_;
+    plane.seeded = hasPlane_ && seeded;
+    plane.inliers = bestInliers;
+    plane.iterations = iterations;
+}
+
+static void resizeCloud(sensor_msgs::PointCloud2 &cloud, size_t count)
+{
+    cloud.height = 1;
+    cloud.width = count;
+    sensor_msgs::PointCloud2Modifier modifier(cloud);
+    modifier.setPointCloud2FieldsByString(1, "xyz");
+    modifier.resize(count);
+    cloud.is_dense = true;
+}
+
+void GroundSegmenter::split(sensor_msgs::PointCloud2 &ground, sensor_msgs::PointCloud2 &obstacles) const
+{
+    size_t count = width_*height_, groundPoints = 0, obstaclePoints = 0;
+    std::vector<uint8_t> label(count);
+    for (size_t i = 0; i < count; i++) {
+	const float *p = &points_[3*i];
+	if (!valid(i))
+	    continue;
+	float d = plane_[0]*p[0] + plane_[1]*p[1] + plane_[2]*p[2] + plane_[3];
+	label[i] = hasPlane_ && fabs(d) < settings_.distance ? 1 : 2;
+	if (label[i] == 1)
+	    groundPoints++;
+	else
+	    obstaclePoints++;
+    }
+    resizeCloud(ground, groundPoints);
+    resizeCloud(obstacles, obstaclePoints);
+    uint8_t *g = ground.data.empty() ? NULL : &ground.data[0];
+    uint8_t *o = obstacles.data.empty() ? NULL : &obstacles.data[0];
+    for (size_t i = 0; i < count; i++) {
+	if (label[i] == 1) {
+	    memcpy(g, &points_[3*i], 3*sizeof(float));
+	    g += ground.point_step;
+	} else if (label[i] == 2) {
+	    memcpy(o, &points_[3*i], 3*sizeof(float));
+	    o += obstacles.point_step;
+	}
+    }
+}
+
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/height_map.hpp>
+
+#include <math.h>
+#include <limits>
+#include <algorithm>
+
+namespace bta_tof_driver {
+
+HeightMap::HeightMap(const Settings &settings) :
+    settings_(settings)
+{
+    settings_.cellSize = std::max(settings_.cellSize, 0.001);
+    cellsX_ = std::max(1.0, ceil(settings_.length/settings_.cellSize));
+    cellsY_ = std::max(1.0, ceil(settings_.width/settings_.cellSize));
+    originX_ = settings_.originX;
+    originY_ = -0.5*cellsY_*settings_.cellSize;
+    scale_ = 1.0/settings_.cellSize;
+    cells_.resize(cellsX_*cellsY_);
+
+    // Same convention as the published extrinsics: fixed axes roll, pitch
+    // and yaw, R = Rz*Ry*Rx
+    std::vector<double> e = settings_.extrinsics;
+    e.resize(6, 0.0);
+    double cr = cos(e[3]), sr = sin(e[3]);
+    double cp = cos(e[4]), sp = sin(e[4]);
+    double cy = cos(e[5]), sy = sin(e[5]);
+    r_[0] = cy*cp; r_[1] = cy*sp*sr - sy*cr; r_[2] = cy*sp*cr + sy*sr;
+    r_[3] = sy*cp; r_[4] = sy*sp*sr + cy*cr; r_[5] = sy*sp*cr - cy*sr;
+    r_[6] = -sp;   r_[7] = cp*sr;            r_[8] = cp*cr;
+    t_[0] = e[0];
+    t_[1] = e[1];
+    t_[2] = e[2];
+    clear();
+}
+
+void HeightMap::clear()
+{
+    Cell empty;
+    empty.max = -std::numeric_limits<float>::infinity();
+    empty.min = std::numeric_limits<float>::infinity();
+    empty.count = 0;
+    std::fill(cells_.begin(), cells_.end(), empty);
+}
+
+void HeightMap::toMsg(HeightGrid &msg) const
+{
+    msg.header.frame_id = settings_.frameId;
+    msg.resolution = settings_.cellSize;
+    msg.width = cellsX_;
+    msg.height = cellsY_;
+    msg.origin_x = originX_;
+    msg.origin_y = originY_;
+    msg.max_height.resize(cells_.size());
+    msg.min_height.resize(cells_.size());
+    msg.count.resize(cells_.size());
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (size_t k = 0; k < cells_.size(); k++) {
+	const Cell &cell = cells_[k];
+	msg.max_height[k] = cell.count ? cell.max : nan;
+	msg.min_height[k] = cell.count ? cell.min : nan;
+	msg.count[k] = std::min<uint32_t>(cell.count, 0xffff);
+    }
+}
+
+}
@@ -0,0 +1,154 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/load_shedder.hpp>
+
+#include <string.h>
+#include <algorithm>
+
+namespace bta_tof_driver {
+
+// Decay of the cost of an output shed for load, per frame. Costs are only
+// measured while admitted, so a stale estimate would shed it for good; this
+// readmits it as a probe after a few frames once the budget would fit.
+static const double shedCostDecay = 0.95;
+
+LoadShedder::LoadShedder(const Policy *policies, double loadLimit) :
+    loadLimit_(loadLimit),
+    period_(0),
+    lastCounter_(0),
+    first_(true)
+{
+    for (int i = 0; i < Outputs; i++) {
+	policies_[i] = policies[i];
+	order_[i] = (Output)i;
+	admitted_[i] = true;
+    }
+    // Insertion sort by priority, ties keep the order of the enum
+    for (int i = 1; i < Outputs; i++)
+	for (int j = i; j > 0 && policies_[order_[j]].priority < policies_[order_[j-1]].priority; j--)
+	    std::swap(order_[j], order_[j-1]);
+    memset(&stats_, 0, sizeof(stats_));
+    memset(cost_, 0, sizeof(cost_));
+}
+
+const char *LoadShedder::getName(Output output)
+{
+    switch (output) {
+    case Amplitudes:
+	return "amplitudes";
+    case Distances:
+	return "distances";
+    case Cloud:
+	return "cloud";
+    default:
+	return "unknown";
+    }
+}
+
+void LoadShedder::plan(const ros::Time &stamp, uint32_t frameCounter, bool queued,
+		       const bool *wanted)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    stats_.frames++;
+    uint32_t lost = 0;
+    if (!first_) {
+	double dt = (stamp - lastStamp_).toSec();
+	if (dt > 0)
+	    period_ = period_ > 0 ? 0.9*period_ + 0.1*dt : dt;
+	if (frameCounter > lastCounter_ + 1)
+	    lost = frameCounter - lastCounter_ - 1;
+    }
+    first_ = false;
+    lastStamp_ = stamp;
+    lastCounter_ = frameCounter;
+
+    bool behind = queued || lost > 0;
+    if (behind)
+	stats_.behind++;
+    double budget = loadLimit_*period_;
+    if (behind)
+	budget /= 2;
+
+    double used = 0;
+    for (int i = 0; i < Outputs; i++) {
+	Output output = order_[i];
+	const Policy &policy = policies_[output];
+	admitted_[output] = false;
+	if (!wanted[output])
+	    continue;
+	// Half a frame of slack, so 10 Hz out of 30 Hz is every third frame
+	if (policy.maxRate > 0 && !lastPublished_[output].isZero() &&
+		(stamp - lastPublished_[output]).toSec() < 1/policy.maxRate - period_/2) {
+	    stats_.rateLimited[output]++;
+	    continue;
+	}
+	// Without an estimate of the period there is nothing to budget
+	if (policy.priority > 0 && period_ > 0 &&
+		used + cost_[output] > budget) {
+	    stats_.overload[output]++;
+	    cost_[output] *= shedCostDecay;
+	    continue;
+	}
+	admitted_[output] = true;
+	used += cost_[output];
+	lastPublished_[output] = stamp;
+	stats_.published[output]++;
+    }
+}
+
+void LoadShedder::record(Output output, double cost)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    double &average = cost_[output];
+    average = average > 0 ? 0.9*average + 0.1*cost : cost;
+}
+
+void LoadShedder::getStats(Stats &stats)
+{
+    boost::mutex::scoped_lock lock(mutex_);
+    stats = stats_;
+    memcpy(stats.cost, cost_, sizeof(cost_));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+}
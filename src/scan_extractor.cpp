@@ -0,0 +1,180 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/scan_extractor.hpp>
+
+#include <math.h>
+#include <limits>
+#include <algorithm>
+
+namespace bta_tof_driver {
+
+ScanExtractor::ScanExtractor(const Settings &settings) :
+    settings_(settings),
+    width_(0),
+    height_(0),
+    fx_(0), fy_(0), cx_(0), cy_(0),
+    firstRow_(0),
+    rows_(0),
+    angleMin_(0),
+    angleIncrement_(0)
+{
+}
+
+bool ScanExtractor::configure(const sensor_msgs::CameraInfo &info, uint16_t width, uint16_t height)
+{
+    // Intrinsics of the calibrated resolution moved to the region of
+    // interest and binning, then scaled to the image
+    double bx = std::max(info.binning_x, 1u), by = std::max(info.binning_y, 1u);
+    double fx = info.K[0]/bx, cx = (info.K[2] - info.roi.x_offset + 0.5)/bx - 0.5;
+    double fy = info.K[4]/by, cy = (info.K[5] - info.roi.y_offset + 0.5)/by - 0.5;
+    uint32_t fullWidth = info.roi.width ? info.roi.width : info.width;
+    uint32_t fullHeight = info.roi.height ? info.roi.height : info.height;
+    double sx = fullWidth ? width*bx/fullWidth : 1.0;
+    double sy = fullHeight ? height*by/fullHeight : 1.0;
+    fx *= sx;
+    cx = (cx + 0.5)*sx - 0.5;
+    fy *= sy;
+    cy = (cy + 0.5)*sy - 0.5;
+    if (fx <= 0 || fy <= 0 || width < 2)
+	return false;
+    if (width == width_ && height == height_ && fx == fx_ && fy == fy_ &&
+	    cx == cx_ && cy == cy_)
+	return true;
+    width_ = width;
+    height_ = height;
+    fx_ = fx;
+    fy_ = fy;
+    cx_ = cx;
+    cy_ = cy;
+
+    rows_ = std::max(1, std::min(settings_.rows, (int)height));
+    firstRow_ = settings_.firstRow < 0 ? (height - rows_)/2 :
+	std::min(settings_.firstRow, height - rows_);
+
+    scale_.resize(rows_*width);
+    for (int r = 0; r < rows_; r++) {
+	double y = (firstRow_ + r - cy)/fy;
+	for (int c = 0; c < width; c++) {
+	    double x = (c - cx)/fx;
+	    scale_[r*width + c] = sqrt((x*x + 1)/(x*x + y*y + 1));
+	}
+    }
+
+    // Image x points right, scan angles count to the left
+    angleMin_ = -atan((width - 1 - cx)/fx);
+    float angleMax = atan(cx/fx);
+    angleIncrement_ = (angleMax - angleMin_)/(width - 1);
+    // Columns are evenly spaced in tan, not in angle: each beam takes the
+    // columns within half an increment, at least the one at its angle
+    firstColumn_.resize(width);
+    lastColumn_.resize(width);
+    for (int k = 0; k < width; k++) {
+	double angle = angleMin_ + k*angleIncrement_;
+	long first = lround(cx - fx*tan(angle + 0.5*angleIncrement_));
+	long last = lround(cx - fx*tan(angle - 0.5*angleIncrement_));
+	if (first > last)
+	    first = last = lround(cx - fx*tan(angle));
+	firstColumn_[k] = std::max(0L, std::min(first, (long)width - 1));
+	lastColumn_[k] = std::max(0L, std::min(last, (long)width - 1));
+    }
+    closest_.resize(width);
+    return true;
+}
+
+/**
+ *
+ * @brief Closest projected range per column. Invalid pixels (0) are
+ * infinite here so that min skips them; written without branches so the
+ * inner loop vectorizes.
+ *
+ */
+template <typename T>
+static void closestPerColumn(const T *distances, const float *scale, int rows,
+			     int width, float conv, float *closest)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    std::fill(closest, closest + width, inf);
+    for (int r = 0; r < rows; r++, distances += width, scale += width) {
+	for (int c = 0; c < width; c++) {
+	    float range = distances[c] > 0 ? distances[c]*conv*scale[c] : inf;
+	    closest[c] = std::min(closest[c], range);
+	}
+    }
+}
+
+bool ScanExtractor::extract(const sensor_msgs::CameraInfo &info, const void *distances,
+			    BTA_DataFormat format, float conv, uint16_t width, uint16_t height,
+			    sensor_msgs::LaserScan &scan)
+{
+    if (!configure(info, width, height))
+	return false;
+
+    if (format == BTA_DataFormatUInt16)
+	closestPerColumn(static_cast<const uint16_t *>(distances) + firstRow_*width,
+			 &scale_[0], rows_, width, conv, &closest_[0]);
+    else if (format == BTA_DataFormatFloat32)
+	closestPerColumn(static_cast<const float *>(distances) + firstRow_*width,
+			 &scale_[0], rows_, width, conv, &closest_[0]);
+    else
+	return false;
+
+    scan.header.frame_id = settings_.frameId;
+    scan.angle_min = angleMin_;
+    scan.angle_max = angleMin_ + angleIncrement_*(width - 1);
+    scan.angle_increment = angleIncrement_;
+    scan.time_increment = 0;
+    scan.range_min = settings_.rangeMin;
+    scan.range_max = settings_.rangeMax;
+    // Beams without any measurement are NaN: +inf would claim free space
+    const float inf = std::numeric_limits<float>::infinity();
+    scan.ranges.resize(width);
+    for (int k = 0; k < width; k++) {
+	float range = inf;
+	for (uint32_t c = firstColumn_[k]; c <= lastColumn_[k]; c++)
+	    range = std::min(range, closest_[c]);
+	scan.ranges[k] = range < inf ? range : std::numeric_limits<float>::quiet_NaN();
+    }
+    return true;
+}
+
+}
@@ -39,19 +39,46 @@
  * Github repository: https://github.com/voxel-dot-at/bta_ros
  *
  */
-#include <bta_ros/sensor2D.hpp>
+#include <bta_tof_driver/sensor2D.hpp>
+#include <bta_tof_driver/diagnostics.hpp>
+#include <bta_tof_driver/paths.hpp>
 
-namespace bta_ros 
+namespace bta_tof_driver 
 {
 	Sensor2D::Sensor2D(ros::NodeHandle nh_camera, 
 										ros::NodeHandle nh_private, 
 										std::string nodeName) : 
 		nh_(nh_camera),
 		nh_private_(nh_private),
-		it_(nh_camera),
-		cim_rgb_(nh_camera),
 		nodeName_(nodeName),
-		address_("192.168.0.10")
+		cim_rgb_(nh_camera),
+		it_(nh_camera),
+		gstImages_(false),
+		address_("192.168.0.10"),
+		lowLatency_(false),
+		sync_(true),
+		drop_(true),
+		dropOnLatency_(false),
+		decoderThreads_(0),
+		skipFrame_(5),
+		convertThreads_(1),
+		maxBuffers_(1),
+		latency_(-1),
+		format_("BGR"),
+		previewFormat_("BGR"),
+		previewWidth_(320),
+		previewHeight_(0),
+		previewRate_(5.0),
+		reconnectMinDelay_(0.5),
+		reconnectMaxDelay_(30.0),
+		streamTimeout_(5.0),
+		sdpStale_(false),
+		receiving_(false),
+		outages_(0),
+		stampSource_("receive"),
+		ntpCaps_(NULL),
+		bgrsink(NULL),
+		tee_(NULL)
 	{
 	
 		if( ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, 
@@ -76,16 +103,94 @@ namespace bta_ros
 
 	  sinkpad = gst_element_get_static_pad ( elem , "sink" );
 	  g_assert (sinkpad);
-	  lres == gst_pad_link ( pad, sinkpad ); 
+	  lres = gst_pad_link ( pad, sinkpad ); 
 	  g_assert (GST_PAD_LINK_SUCCESSFUL(lres));
 	  gst_object_unref( sinkpad );
 	}
 
+	void Sensor2D::readConfig() {
+		nh_private_.getParam(nodeName_+"/2dLowLatency", lowLatency_);
+		if (lowLatency_) {
+			// Frame threading delays every frame by one frame per thread
+			decoderThreads_ = 1;
+			latency_ = 20;
+			dropOnLatency_ = true;
+			sync_ = false;
+		}
+		nh_private_.getParam(nodeName_+"/2dDecoderThreads", decoderThreads_);
+		nh_private_.getParam(nodeName_+"/2dSkipFrame", skipFrame_);
+		nh_private_.getParam(nodeName_+"/2dConvertThreads", convertThreads_);
+		nh_private_.getParam(nodeName_+"/2dMaxBuffers", maxBuffers_);
+		nh_private_.getParam(nodeName_+"/2dDrop", drop_);
+		nh_private_.getParam(nodeName_+"/2dSync", sync_);
+		nh_private_.getParam(nodeName_+"/2dLatency", latency_);
+		nh_private_.getParam(nodeName_+"/2dDropOnLatency", dropOnLatency_);
+		nh_private_.getParam(nodeName_+"/2dReconnectMinDelay", reconnectMinDelay_);
+		nh_private_.getParam(nodeName_+"/2dReconnectMaxDelay", reconnectMaxDelay_);
+		nh_private_.getParam(nodeName_+"/2dStreamTimeout", streamTimeout_);
+		if (!nh_private_.getParam(nodeName_+"/2dSdpCacheFile", sdpCacheFile_))
+			sdpCacheFile_ = rosCacheFile(nodeName_, ".sdp");
+		else
+			sdpCacheFile_ = expandHome(sdpCacheFile_);
+		nh_private_.getParam(nodeName_+"/2dStampSource", stampSource_);
+		if (stampSource_ != "receive" && stampSource_ != "rtcp" && stampSource_ != "publish") {
+			ROS_WARN_STREAM("Unsupported 2dStampSource " << stampSource_ << ", using receive");
+			stampSource_ = "receive";
+		}
+		nh_private_.getParam(nodeName_+"/2dFormat", format_);
+		nh_private_.getParam(nodeName_+"/2dGstImages", gstImages_);
+		nh_private_.getParam(nodeName_+"/2dPreviewWidth", previewWidth_);
+		nh_private_.getParam(nodeName_+"/2dPreviewHeight", previewHeight_);
+		nh_private_.getParam(nodeName_+"/2dPreviewRate", previewRate_);
+		nh_private_.getParam(nodeName_+"/2dPreviewFormat", previewFormat_);
+		if (format_ != "BGR" && format_ != "I420" && format_ != "NV12") {
+			ROS_WARN_STREAM("Unsupported 2dFormat " << format_ << ", using BGR");
+			format_ = "BGR";
+		}
+		if (previewFormat_ != "BGR" && previewFormat_ != "I420" && previewFormat_ != "NV12") {
+			ROS_WARN_STREAM("Unsupported 2dPreviewFormat " << previewFormat_ << ", using BGR");
+			previewFormat_ = "BGR";
+		}
+
+		ROS_INFO_STREAM("Sensor2D pipeline: format " << format_ << ", decoder threads " << decoderThreads_ <<
+			", skip-frame " << skipFrame_ << ", convert threads " << convertThreads_ <<
+			", max-buffers " << maxBuffers_ << ", drop " << drop_ << ", sync " << sync_ <<
+			", latency " << latency_ << " ms, drop-on-latency " << dropOnLatency_);
+	}
+
+	bool Sensor2D::jitterBufferHasNtpMeta() {
+		GstElement *jitterBuffer = gst_element_factory_make("rtpjitterbuffer", NULL);
+		if (!jitterBuffer)
+			return false;
+		bool found = g_object_class_find_property(G_OBJECT_GET_CLASS(jitterBuffer),
+			"add-reference-timestamp-meta") != NULL;
+		gst_object_unref(jitterBuffer);
+		return found;
+	}
+
+	void Sensor2D::elementAdded(GstBin *bin, GstBin *subBin, GstElement *element, gpointer data) {
+		Sensor2D *self = static_cast<Sensor2D *>(data);
+		// The jitter buffer is created by the rtpbin inside sdpdemux
+		gchar *name = gst_object_get_name(GST_OBJECT(element));
+		if (name && g_str_has_prefix(name, "rtpjitterbuffer")) {
+			g_object_set (element, "drop-on-latency", (gboolean)self->dropOnLatency_, NULL);
+			// NTP capture time from the RTCP sender reports on every buffer
+			if (self->stampSource_ == "rtcp")
+				g_object_set (element, "add-reference-timestamp-meta", TRUE, NULL);
+		}
+		g_free(name);
+	}
+
 	void Sensor2D::init() {
 		GstElement *souphttpsrc, 
 			*sdpdemux, *videodepay, 
 			*videodecoder, *videoconvert, 
-			*filter;
+			*filter, *h264filter, *h264parse,
+			*rawqueue, *h264queue;
+		GstElement *rawtee, *imagequeue, *bgrqueue = NULL,
+			*bgrconvert = NULL, *bgrfilter = NULL,
+			*previewqueue, *previewrate, *previewscale,
+			*previewconvert, *previewfilter;
 		//GstElement *pipeline_;
 	
 		gboolean res;
@@ -97,6 +202,7 @@ namespace bta_ros
 	  if(!nh_private_.getParam(nodeName_+"/2dURL",address_))
 			ROS_INFO_STREAM(
 				"No ip for download sdp file given. Trying with default: " << address_);
+		readConfig();
 	  	
 		// always init first 
 		gst_init (NULL,NULL);
@@ -104,25 +210,74 @@ namespace bta_ros
 		// the pipeline_ to hold everything 
 		pipeline_ = gst_pipeline_new ("pipeline");
 		g_assert (pipeline_);
-	
-		souphttpsrc = gst_element_factory_make ("souphttpsrc", "sdphttpsrc");
-		g_assert (souphttpsrc);
-		g_object_set (souphttpsrc, "location", address_.c_str(), NULL);
+		g_signal_connect (pipeline_, "deep-element-added", G_CALLBACK (&Sensor2D::elementAdded), this);
+		// buffer times map directly to wall time on a real time clock
+		GstClock *clock = GST_CLOCK (g_object_new (GST_TYPE_SYSTEM_CLOCK,
+			"clock-type", GST_CLOCK_TYPE_REALTIME, NULL));
+		gst_pipeline_use_clock (GST_PIPELINE (pipeline_), clock);
+		gst_object_unref (clock);
+		if (stampSource_ == "rtcp" && !jitterBufferHasNtpMeta()) {
+			ROS_WARN("This GStreamer's rtpjitterbuffer cannot attach the RTCP "
+				"capture time, 2dStampSource rtcp needs a newer release. Using receive.");
+			stampSource_ = "receive";
+		}
+		if (stampSource_ == "rtcp")
+			ntpCaps_ = gst_caps_from_string ("timestamp/x-ntp");
+	
+		// With a cached SDP a restart does not have to ask the camera again
+		if (sdpCacheFile_.empty()) {
+			souphttpsrc = gst_element_factory_make ("souphttpsrc", "sdphttpsrc");
+			g_assert (souphttpsrc);
+			g_object_set (souphttpsrc, "location", address_.c_str(), NULL);
+		} else {
+			souphttpsrc = gst_element_factory_make ("filesrc", "sdpfilesrc");
+			g_assert (souphttpsrc);
+			g_object_set (souphttpsrc, "location", sdpCacheFile_.c_str(), NULL);
+		}
 	
 		sdpdemux = gst_element_factory_make ("sdpdemux", NULL);
 		g_assert (sdpdemux);
 		//g_object_set (sdpdemux, "debug", TRUE, NULL);
 		//g_object_set (sdpdemux, "redirect", FALSE, NULL);
-		//g_object_set (sdpdemux, "latency", 0, NULL);
+		if (latency_ >= 0)
+			g_object_set (sdpdemux, "latency", (guint)latency_, NULL);
 	
 		// the depayloading 
 		videodepay = gst_element_factory_make ("rtph264depay", NULL);
 		g_assert (videodepay);
+
+		// whole access units, so every buffer can be published as it is
+		h264filter = gst_element_factory_make ("capsfilter", NULL);
+		g_assert (h264filter);
+		GstCaps *h264caps = gst_caps_new_simple ("video/x-h264",
+					"stream-format", G_TYPE_STRING, "byte-stream",
+					"alignment", G_TYPE_STRING, "au",
+					NULL);
+		g_object_set (G_OBJECT (h264filter), "caps", h264caps, NULL);
+		gst_caps_unref (h264caps);
+
+		// repeat SPS/PPS with every key frame, so late subscribers and the
+		// decoder can start at any IDR
+		h264parse = gst_element_factory_make ("h264parse", NULL);
+		g_assert (h264parse);
+		g_object_set (h264parse, "config-interval", -1, NULL);
+
+		// the compressed stream is split here; the branches are linked
+		// only while somebody subscribes to them
+		tee_ = gst_element_factory_make ("tee", NULL);
+		g_assert (tee_);
+		g_object_set (tee_, "allow-not-linked", TRUE, NULL);
+
+		rawqueue = gst_element_factory_make ("queue", NULL);
+		g_assert (rawqueue);
+		h264queue = gst_element_factory_make ("queue", NULL);
+		g_assert (h264queue);
 	
 		/* the decoding */
 		videodecoder = gst_element_factory_make ("avdec_h264", NULL);
 		g_assert (videodecoder);
-		g_object_set (videodecoder, "skip-frame", 5, NULL);
+		g_object_set (videodecoder, "skip-frame", skipFrame_, NULL);
+		g_object_set (videodecoder, "max-threads", decoderThreads_, NULL);
 
 		/*tee = gst_element_factory_make ("tee", NULL);
 		g_assert (tee);*/
@@ -152,31 +307,84 @@ namespace bta_ros
 	
 		videoconvert =gst_element_factory_make("videoconvert", NULL);
 		g_assert (videoconvert);
+		g_object_set (videoconvert, "n-threads", (guint)convertThreads_, NULL);
 	
-		filter = gst_element_factory_make ("capsfilter", "filter");
-			g_assert (filter);
-		GstCaps *filtercaps;
-		filtercaps = gst_caps_new_simple ("video/x-raw",
-					 "format", G_TYPE_STRING, "BGR",
-					 NULL);
-			g_object_set (G_OBJECT (filter), "caps", filtercaps, NULL);
-			gst_caps_unref (filtercaps);
-	
-		appsink = gst_element_factory_make("appsink", NULL);
-		g_assert (appsink);
-		//g_object_set (appsink, "emit-signals", TRUE, NULL);
-		g_object_set (appsink, "drop", TRUE, NULL);
-		g_object_set (appsink, "max-buffers", 1, NULL);
+		// I420 is what the decoder produces, so only NV12 and BGR cost a
+		// conversion here
+		filter = makeRawFilter(format_);
+		appsink = makeAppSink(&Sensor2D::newSample);
+		h264sink = makeAppSink(&Sensor2D::newH264Sample);
+
+		// the decoded stream is split again for the image, the BGR
+		// conversion and the preview, each linked only while subscribed
+		rawtee = gst_element_factory_make ("tee", NULL);
+		g_assert (rawtee);
+		g_object_set (rawtee, "allow-not-linked", TRUE, NULL);
+		imagequeue = gst_element_factory_make ("queue", NULL);
+		g_assert (imagequeue);
+
+		if (format_ != "BGR") {
+			// BGR for legacy consumers
+			bgrqueue = gst_element_factory_make ("queue", NULL);
+			g_assert (bgrqueue);
+			bgrconvert = gst_element_factory_make("videoconvert", NULL);
+			g_assert (bgrconvert);
+			g_object_set (bgrconvert, "n-threads", (guint)convertThreads_, NULL);
+			bgrfilter = makeRawFilter("BGR");
+			bgrsink = makeAppSink(&Sensor2D::newBgrSample);
+		}
+
+		// preview: frames are dropped first, then scaled and converted, all
+		// on the thread of a leaky queue that never holds back the others
+		previewqueue = gst_element_factory_make ("queue", NULL);
+		g_assert (previewqueue);
+		g_object_set (previewqueue, "leaky", 2, NULL);
+		g_object_set (previewqueue, "max-size-buffers", 1, NULL);
+		previewrate = gst_element_factory_make ("videorate", NULL);
+		g_assert (previewrate);
+		g_object_set (previewrate, "drop-only", TRUE, NULL);
+		previewscale = gst_element_factory_make ("videoscale", NULL);
+		g_assert (previewscale);
+		previewconvert = gst_element_factory_make ("videoconvert", NULL);
+		g_assert (previewconvert);
+		previewfilter = gst_element_factory_make ("capsfilter", NULL);
+		g_assert (previewfilter);
+		std::ostringstream previewcaps;
+		previewcaps << "video/x-raw,format=" << previewFormat_;
+		if (previewWidth_ > 0)
+			previewcaps << ",width=" << previewWidth_;
+		if (previewHeight_ > 0)
+			previewcaps << ",height=" << previewHeight_;
+		if (previewRate_ > 0)
+			previewcaps << ",framerate=" << (int)(previewRate_*1000) << "/1000";
+		GstCaps *caps = gst_caps_from_string (previewcaps.str().c_str());
+		g_object_set (G_OBJECT (previewfilter), "caps", caps, NULL);
+		gst_caps_unref (caps);
+		previewsink = makeAppSink(&Sensor2D::newPreviewSample);
 	
 		// add depayloading and playback to the pipeline_ and link 
 		gst_bin_add_many (GST_BIN (pipeline_),
 					souphttpsrc,
 					sdpdemux,
 					videodepay, 
+					h264filter,
+					h264parse,
+					tee_,
+					rawqueue,
 					videodecoder,
 					videoconvert,
 					filter, 
+					rawtee,
+					imagequeue,
 					appsink,
+					h264queue,
+					h264sink,
+					previewqueue,
+					previewrate,
+					previewscale,
+					previewconvert,
+					previewfilter,
+					previewsink,
 					NULL);
 	
 		res = gst_element_link (souphttpsrc, sdpdemux);
@@ -185,12 +393,40 @@ namespace bta_ros
 	
 		g_signal_connect (sdpdemux, "pad-added", G_CALLBACK (cb_new_pad), videodepay);
 	
-		res = gst_element_link_many (videodepay, videodecoder, videoconvert, filter, appsink, NULL);
+		res = gst_element_link_many (videodepay, h264filter, h264parse, tee_, NULL);
 		g_assert (res == TRUE);
+		// every access unit proves the stream alive
+		sinkpad = gst_element_get_static_pad (h264parse, "sink");
+		gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER, &Sensor2D::aliveProbe, this, NULL);
+		gst_object_unref (sinkpad);
+		sinkpad = gst_element_get_static_pad (videodecoder, "sink");
+		gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER, &Sensor2D::decodeProbe, this, NULL);
+		gst_object_unref (sinkpad);
+		res = gst_element_link (h264queue, h264sink);
+		g_assert (res == TRUE);
+		res = gst_element_link_many (rawqueue, videodecoder, videoconvert, filter, rawtee, NULL);
+		g_assert (res == TRUE);
+		res = gst_element_link (imagequeue, appsink);
+		g_assert (res == TRUE);
+		res = gst_element_link_many (previewqueue, previewrate, previewscale,
+				previewconvert, previewfilter, previewsink, NULL);
+		g_assert (res == TRUE);
+		if (bgrqueue) {
+			gst_bin_add_many (GST_BIN (pipeline_), bgrqueue, bgrconvert, bgrfilter, bgrsink, NULL);
+			res = gst_element_link_many (bgrqueue, bgrconvert, bgrfilter, bgrsink, NULL);
+			g_assert (res == TRUE);
+		}
+
+		rawBranch_.tee = h264Branch_.tee = tee_;
+		rawBranch_.queue = rawqueue;
+		h264Branch_.queue = h264queue;
+		rawBranch_.waitKeyFrame = h264Branch_.waitKeyFrame = true;
+		imageBranch_.tee = bgrBranch_.tee = previewBranch_.tee = rawtee;
+		imageBranch_.queue = imagequeue;
+		bgrBranch_.queue = bgrqueue;
+		previewBranch_.queue = previewqueue;
 	
 	
-		//g_signal_connect(appsink, "new-sample", G_CALLBACK(newFrame), NULL);
-	
 		//GstElement *session = sdpdemux.session;
 		// the RTP pad that we have to connect to the depayloader will be created
 		// dynamically so we connect to the pad-added signal, pass the depayloader as
@@ -201,122 +437,538 @@ namespace bta_ros
 		// give some stats when we receive RTCP 
 		//g_signal_connect (sdpdemux, "on-ssrc-active", G_CALLBACK (on_ssrc_active_cb), videodepay);
 	
-		// set the pipeline_ to playing 
-		ROS_INFO ("starting receiver pipeline");
-		
-		gst_element_set_state(pipeline_, GST_STATE_PAUSED);
-		if (gst_element_get_state(pipeline_, NULL, NULL, -1) == GST_STATE_CHANGE_FAILURE) {
-			ROS_FATAL("Failed to PAUSE stream, check your configuration.");
-			ros::shutdown();
-			return;
-		} else {
-			ROS_DEBUG("Stream is PAUSED.");
-		}	
-		gst_element_set_state (pipeline_, GST_STATE_PLAYING);
-		if (gst_element_get_state(pipeline_, NULL, NULL, -1) == GST_STATE_CHANGE_FAILURE) {
-			ROS_WARN("Failed to PLAY stream.");
-		}
-		//loop = g_main_loop_new (NULL, FALSE);
-		//g_main_loop_run (loop);
-	
 	 {
 		// Advertise all published topics
 			cim_rgb_.setCameraName(nodeName_);
 			if(cim_rgb_.validateURL(
-					/*camera_info_url_*/"package://bta_ros/calib.yml")) {
-				cim_rgb_.loadCameraInfo("package://bta_ros/calib.yml");
+					/*camera_info_url_*/"package://bta_tof_driver/calib.yml")) {
+				cim_rgb_.loadCameraInfo("package://bta_tof_driver/calib.yml");
 				ROS_INFO_STREAM("Loaded camera calibration from " << 
-					"package://bta_ros/calib.yml"	);
+					"package://bta_tof_driver/calib.yml"	);
 			} else {
 				ROS_WARN_STREAM("Camera info at: " <<
-					"package://bta_ros/calib.yml" <<
+					"package://bta_tof_driver/calib.yml" <<
 					" not found. Using an uncalibrated config.");
 			} 	
 	
-			pub_rgb_ = it_.advertiseCamera(nodeName_ + "/sensor2d/image_raw", 1);
+			// Same topics as an image_transport camera publisher
+			ros::SubscriberStatusCallback update =
+				boost::bind(&Sensor2D::updateBranches, this);
+			advertiseImage(pub_rgb_, "image_raw");
+			pub_rgb_info_ = nh_.advertise<sensor_msgs::CameraInfo>(
+				nodeName_ + "/sensor2d/camera_info", 1, update, update);
+			if (format_ != "BGR")
+				advertiseImage(pub_bgr_, "image_bgr");
+			advertiseImage(pub_preview_, "preview/image_raw");
+			// H.264 access units straight from the depayloader, no decoding
+			pub_h264_ = nh_.advertise<sensor_msgs::CompressedImage>(
+				nodeName_ + "/sensor2d/h264", 1, update, update);
+			updateBranches();
+
+			double statsPeriod = 1.0;
+			nh_private_.getParam(nodeName_+"/2dStatsPeriod", statsPeriod);
+			pub_stats_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+			stats_timer_ = nh_.createWallTimer(ros::WallDuration(statsPeriod),
+				&Sensor2D::publishStats, this);
 
 			//sub_amp_ = nh_private_.subscribe("bta_node_amp", 1, &BtaRos::ampCb, this);
 			//sub_dis_ = nh_private_.subscribe("bta_node_dis", 1, &BtaRos::disCb, this);
 		}
-		GstState state;
+		supervise();
+	
+		//stop();
+	
+		return;
+	}
+
+	void Sensor2D::supervise() {
+		GstBus *bus = gst_element_get_bus(pipeline_);
+		double delay = reconnectMinDelay_;
+		bool running = startStream();
+
 		while (nh_.ok() && !ros::isShuttingDown()) {
-			gst_element_get_state(pipeline_, &state, NULL, -1);
-			if (state == GST_STATE_PLAYING)
-				getFrame();
-			else {
-				ROS_INFO("Stream STOPPED. Reconnecting");
-				gst_element_set_state (pipeline_, GST_STATE_NULL);
-				if (gst_element_set_state (pipeline_, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
-					ROS_ERROR("Failed to PLAY stream.");
+			ros::spinOnce ();
+			// Sleeps until the pipeline reports a problem, at most 100 ms
+			GstMessage *msg = gst_bus_timed_pop_filtered(bus, 100*GST_MSECOND,
+				(GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+			bool failed = !running;
+			if (msg) {
+				if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+					GError *err = NULL;
+					gchar *debug = NULL;
+					gst_message_parse_error(msg, &err, &debug);
+					ROS_WARN_STREAM("Stream error: " << (err ? err->message : "unknown"));
+					g_clear_error(&err);
+					g_free(debug);
+				} else {
+					ROS_WARN("Stream ended.");
 				}
+				gst_message_unref(msg);
+				failed = true;
+			} else if (running && streamTimeout_ > 0 && timeSinceBuffer() > streamTimeout_) {
+				// UDP does not fail, it just stops delivering
+				ROS_WARN_STREAM("No data for " << streamTimeout_ << " s.");
+				failed = true;
+			}
+			if (!failed) {
+				if (receiving_)
+					delay = reconnectMinDelay_;
+				continue;
 			}
-			ros::spinOnce ();	
+
+			if (running) {
+				boost::mutex::scoped_lock lock(stats_mutex_);
+				outages_++;
+			}
+			gst_element_set_state (pipeline_, GST_STATE_NULL);
+			// A cached SDP that never produced data may be outdated
+			if (!receiving_)
+				sdpStale_ = true;
+			ROS_INFO_STREAM("Stream STOPPED. Reconnecting in " << delay << " s");
+			ros::WallTime retry = ros::WallTime::now() + ros::WallDuration(delay);
+			while (nh_.ok() && !ros::isShuttingDown() && ros::WallTime::now() < retry) {
+				ros::spinOnce ();
+				ros::WallDuration(0.1).sleep();
+			}
+			delay = std::min(delay*2, reconnectMaxDelay_);
+			running = startStream();
 		}
-		
-		//stop();
-	
-		return;
+		gst_object_unref(bus);
+	}
+
+	bool Sensor2D::startStream() {
+		if (!sdpCacheFile_.empty()) {
+			struct stat st;
+			bool cached = stat(sdpCacheFile_.c_str(), &st) == 0 && st.st_size > 0;
+			if ((!cached || sdpStale_) && !fetchSdp() && !cached)
+				return false;
+			sdpStale_ = false;
+		}
+
+		receiving_ = false;
+		{
+			boost::mutex::scoped_lock lock(stats_mutex_);
+			lastBuffer_ = ros::WallTime::now();
+		}
+		ROS_INFO ("starting receiver pipeline");
+		if (gst_element_set_state (pipeline_, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+			ROS_WARN("Failed to PLAY stream.");
+			gst_element_set_state (pipeline_, GST_STATE_NULL);
+			return false;
+		}
+		return true;
+	}
+
+	bool Sensor2D::fetchSdp() {
+		GstElement *fetch = gst_pipeline_new ("sdpfetch");
+		GstElement *src = gst_element_factory_make ("souphttpsrc", NULL);
+		GstElement *sink = gst_element_factory_make ("filesink", NULL);
+		g_assert (fetch && src && sink);
+		std::string tmp = sdpCacheFile_ + ".tmp";
+		g_object_set (src, "location", address_.c_str(), NULL);
+		g_object_set (src, "timeout", (guint)5, NULL);
+		g_object_set (sink, "location", tmp.c_str(), NULL);
+		gst_bin_add_many (GST_BIN (fetch), src, sink, NULL);
+		gst_element_link (src, sink);
+
+		bool ok = false;
+		if (gst_element_set_state (fetch, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+			GstBus *bus = gst_element_get_bus (fetch);
+			GstMessage *msg = gst_bus_timed_pop_filtered (bus, 5*GST_SECOND,
+				(GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+			ok = msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+			if (msg)
+				gst_message_unref (msg);
+			gst_object_unref (bus);
+		}
+		gst_element_set_state (fetch, GST_STATE_NULL);
+		gst_object_unref (GST_OBJECT (fetch));
+
+		// Replace the cache atomically, a failed download keeps the old one
+		if (ok && rename(tmp.c_str(), sdpCacheFile_.c_str()) == 0) {
+			ROS_INFO_STREAM("Fetched SDP from " << address_ << " into " << sdpCacheFile_);
+			return true;
+		}
+		remove(tmp.c_str());
+		ROS_WARN_STREAM("Could not fetch SDP from " << address_);
+		return false;
+	}
+
+	double Sensor2D::timeSinceBuffer() {
+		boost::mutex::scoped_lock lock(stats_mutex_);
+		return (ros::WallTime::now() - lastBuffer_).toSec();
+	}
+
+	GstPadProbeReturn Sensor2D::aliveProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+		Sensor2D *self = static_cast<Sensor2D *>(data);
+		{
+			boost::mutex::scoped_lock lock(self->stats_mutex_);
+			self->lastBuffer_ = ros::WallTime::now();
+		}
+		self->receiving_ = true;
+		// Time from reception of the first packet to the complete access
+		// unit, mostly spent in the jitter buffer
+		self->addLatency(self->jitterDelay_, self->bufferAge(GST_PAD_PROBE_INFO_BUFFER(info)));
+		return GST_PAD_PROBE_OK;
 	}
 
 	void Sensor2D::stop() {
+		// no more branch updates from subscriber callbacks
+		pub_rgb_.shutdown();
+		pub_rgb_info_.shutdown();
+		pub_h264_.shutdown();
+		pub_bgr_.shutdown();
+		pub_preview_.shutdown();
+		stats_timer_.stop();
+
 		g_print ("Returned, stopping playback\n");
 	 	gst_element_set_state (pipeline_, GST_STATE_NULL);
 	
 		g_print ("Deleting pipeline_\n");
 		gst_object_unref (GST_OBJECT (pipeline_));
+		if (ntpCaps_)
+			gst_caps_unref (ntpCaps_);
 
 		return;
 	}
 
-	void Sensor2D::getFrame() {
-		GstSample *sample;
-	
-		sample = gst_app_sink_pull_sample((GstAppSink *)appsink);
+	void Sensor2D::advertiseImage(ImagePublisher &pub, const std::string &topic) {
+		std::string name = nodeName_ + "/sensor2d/" + topic;
+		if (gstImages_) {
+			ros::SubscriberStatusCallback update =
+				boost::bind(&Sensor2D::updateBranches, this);
+			pub.gst = nh_.advertise<GstImage>(name, 1, update, update);
+		} else {
+			image_transport::SubscriberStatusCallback update =
+				boost::bind(&Sensor2D::updateBranches, this);
+			pub.it = it_.advertise(name, 1, update, update);
+		}
+	}
+
+	void Sensor2D::updateBranches() {
+		boost::mutex::scoped_lock lock(branch_mutex_);
+		bool raw = pub_rgb_.getNumSubscribers() > 0 || pub_rgb_info_.getNumSubscribers() > 0 ||
+			(imageDemand_ && imageDemand_());
+		bool bgr = pub_bgr_.getNumSubscribers() > 0;
+		bool preview = pub_preview_.getNumSubscribers() > 0;
+		setBranchLinked(rawBranch_, raw || bgr || preview);
+		setBranchLinked(imageBranch_, raw);
+		setBranchLinked(bgrBranch_, bgr);
+		setBranchLinked(previewBranch_, preview);
+		setBranchLinked(h264Branch_, pub_h264_.getNumSubscribers() > 0);
+	}
+
+	void Sensor2D::setBranchLinked(Branch &branch, bool linked) {
+		if (!branch.queue || linked == (branch.teePad != NULL))
+			return;
+		if (linked) {
+			branch.teePad = gst_element_get_request_pad(branch.tee, "src_%u");
+			GstPad *sinkpad = gst_element_get_static_pad(branch.queue, "sink");
+			// H.264 is useless before the next key frame
+			if (branch.waitKeyFrame)
+				gst_pad_add_probe(branch.teePad, GST_PAD_PROBE_TYPE_BUFFER,
+					&Sensor2D::keyFrameProbe, NULL, NULL);
+			if (!GST_PAD_LINK_SUCCESSFUL(gst_pad_link(branch.teePad, sinkpad)))
+				ROS_WARN("Could not link pipeline branch.");
+			gst_object_unref(sinkpad);
+			ROS_DEBUG("Pipeline branch linked.");
+		} else {
+			// Unlink once no buffer is in flight on the tee pad
+			GstPad *teePad = branch.teePad;
+			branch.teePad = NULL;
+			gst_pad_add_probe(teePad, GST_PAD_PROBE_TYPE_IDLE,
+				&Sensor2D::unlinkProbe, branch.tee, NULL);
+			ROS_DEBUG("Pipeline branch unlinked.");
+		}
+	}
+
+	GstPadProbeReturn Sensor2D::keyFrameProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+		GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+		if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+			return GST_PAD_PROBE_DROP;
+		return GST_PAD_PROBE_REMOVE;
+	}
+
+	GstPadProbeReturn Sensor2D::unlinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+		GstElement *tee = static_cast<GstElement *>(data);
+		GstPad *peer = gst_pad_get_peer(pad);
+		if (peer) {
+			gst_pad_unlink(pad, peer);
+			gst_object_unref(peer);
+		}
+		gst_element_release_request_pad(tee, pad);
+		gst_object_unref(pad);
+		return GST_PAD_PROBE_REMOVE;
+	}
+
+	GstFlowReturn Sensor2D::newH264Sample(GstAppSink *sink, gpointer data) {
+		Sensor2D *self = static_cast<Sensor2D *>(data);
+		GstSample *sample = gst_app_sink_pull_sample(sink);
+		if (sample == NULL)
+			return GST_FLOW_OK;
+
+		GstBuffer *buffer = gst_sample_get_buffer(sample);
+		GstMapInfo map;
+		self->addLatency(self->h264Latency_, self->bufferAge(buffer));
+		if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+			sensor_msgs::CompressedImagePtr h264(new sensor_msgs::CompressedImage);
+			h264->header.stamp = self->getStamp(buffer);
+			h264->header.frame_id = self->nodeName_+"/sensor2d";
+			h264->format = "h264";
+			h264->data.assign(map.data, map.data + map.size);
+			gst_buffer_unmap(buffer, &map);
+			self->pub_h264_.publish(h264);
+		}
+		gst_sample_unref(sample);
+		return GST_FLOW_OK;
+	}
+
+	GstElement *Sensor2D::makeAppSink(NewSampleCallback callback) {
+		GstElement *sink = gst_element_factory_make("appsink", NULL);
+		g_assert (sink);
+		g_object_set (sink, "drop", (gboolean)drop_, NULL);
+		g_object_set (sink, "max-buffers", (guint)maxBuffers_, NULL);
+		g_object_set (sink, "sync", (gboolean)sync_, NULL);
+		// branches come and go, the pipeline must not wait for a preroll
+		g_object_set (sink, "async", FALSE, NULL);
+		// Frames are handed over on the streaming thread as they are
+		// decoded, nobody has to poll the sink
+		GstAppSinkCallbacks callbacks;
+		memset(&callbacks, 0, sizeof(callbacks));
+		callbacks.new_sample = callback;
+		gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, this, NULL);
+		return sink;
+	}
+
+	GstElement *Sensor2D::makeRawFilter(const std::string &format) {
+		GstElement *filter = gst_element_factory_make ("capsfilter", NULL);
+		g_assert (filter);
+		GstCaps *filtercaps = gst_caps_new_simple ("video/x-raw",
+					"format", G_TYPE_STRING, format.c_str(),
+					NULL);
+		g_object_set (G_OBJECT (filter), "caps", filtercaps, NULL);
+		gst_caps_unref (filtercaps);
+		return filter;
+	}
+
+	std::string Sensor2D::getEncoding(const GstVideoInfo &info) {
+		switch (GST_VIDEO_INFO_FORMAT(&info)) {
+			case GST_VIDEO_FORMAT_BGR:
+				return sensor_msgs::image_encodings::BGR8;
+			case GST_VIDEO_FORMAT_I420:
+				return "i420";
+			case GST_VIDEO_FORMAT_NV12:
+				return "nv12";
+			default:
+				return "";
+		}
+	}
+
+	GstFlowReturn Sensor2D::newSample(GstAppSink *sink, gpointer data) {
+		Sensor2D *self = static_cast<Sensor2D *>(data);
+		GstSample *sample = gst_app_sink_pull_sample(sink);
+		if (sample != NULL)
+			self->publishSample(sample, self->pub_rgb_, true);
+		return GST_FLOW_OK;
+	}
+
+	GstFlowReturn Sensor2D::newBgrSample(GstAppSink *sink, gpointer data) {
+		Sensor2D *self = static_cast<Sensor2D *>(data);
+		GstSample *sample = gst_app_sink_pull_sample(sink);
+		// camera_info goes out with image_raw, unless only BGR is wanted
+		if (sample != NULL)
+			self->publishSample(sample, self->pub_bgr_,
+				self->pub_rgb_.getNumSubscribers() == 0);
+		return GST_FLOW_OK;
+	}
+
+	GstFlowReturn Sensor2D::newPreviewSample(GstAppSink *sink, gpointer data) {
+		Sensor2D *self = static_cast<Sensor2D *>(data);
+		GstSample *sample = gst_app_sink_pull_sample(sink);
+		if (sample != NULL)
+			self->publishSample(sample, self->pub_preview_, false);
+		return GST_FLOW_OK;
+	}
+
+	void Sensor2D::publishSample(GstSample *sample, ImagePublisher &pub, bool withInfo) {
+		ROS_DEBUG("		frame 2D Arrived");
+		withInfo = withInfo && pub_rgb_info_.getNumSubscribers() > 0;
+		bool callback = &pub == &pub_rgb_ && imageCallback_ && imageDemand_();
+		if (pub.getNumSubscribers() == 0 && !withInfo && !callback) {
+			gst_sample_unref(sample);
+			return;
+		}
+
+		GstVideoInfo info;
+		if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+			ROS_DEBUG ("could not get snapshot dimension\n");
+			gst_sample_unref(sample);
+			return;
+		}
+
+		GstBuffer *buffer = gst_sample_get_buffer(sample);
+		if (&pub != &pub_preview_) {
+			addLatency(rawLatency_, bufferAge(buffer));
+			addLatency(decodeLatency_, decodeTime(buffer));
+		}
+		ros::Time stamp = buffer ? getStamp(buffer) : ros::Time::now();
+
+		// The message keeps the sample, and with it the decoder's buffer,
+		// until the last subscriber is done with it
+		GstImagePtr rgb(new GstImage(sample));
+		if (!rgb->isMapped())
+			return;
+		rgb->header.stamp = stamp;
+		rgb->header.frame_id = nodeName_+"/sensor2d";
+		rgb->height = GST_VIDEO_INFO_HEIGHT(&info);
+		rgb->width = GST_VIDEO_INFO_WIDTH(&info);
+		rgb->encoding = getEncoding(info);
+		// Rows may be padded, the stride comes from the caps. For YUV this
+		// is the luma stride, the chroma planes follow as laid out by
+		// GStreamer.
+		rgb->step = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+		rgb->size = std::min(rgb->size, (size_t)GST_VIDEO_INFO_SIZE(&info));
+
+		sensor_msgs::CameraInfoPtr ci_rgb(
+			new sensor_msgs::CameraInfo(cim_rgb_.getCameraInfo()));
+		ci_rgb->header = rgb->header;
+
+		if (pub.gst)
+			pub.gst.publish(rgb);
+		else if (pub.it.getNumSubscribers() > 0)
+			pub.it.publish(rgb->copy());
+		if (withInfo)
+			pub_rgb_info_.publish(ci_rgb);
+		if (callback)
+			imageCallback_(rgb);
+	}
+
+	void Sensor2D::setImageCallback(const ImageCallback &callback, const DemandCallback &demand) {
+		imageCallback_ = callback;
+		imageDemand_ = demand;
+	}
 	
-		if(sample != NULL) {
-			ROS_DEBUG("		frame 2D Arrived");
-			sensor_msgs::ImagePtr rgb (new sensor_msgs::Image);
-		  GstBuffer* sampleBuffer = NULL;
-			GstStructure *s;
-			gint width, height;
-			GstMapInfo bufferInfo;
-			gboolean res;
-			GstCaps *caps;
-		  
-	  	caps = gst_sample_get_caps (sample);
-	  	s = gst_caps_get_structure (caps, 0);
-	  	res = gst_structure_get_int (s, "width", &width);
-			res |= gst_structure_get_int (s, "height", &height);
-			if (!res) {
-				ROS_DEBUG ("could not get snapshot dimension\n");
-				return;
+	GstClockTime Sensor2D::runningTime() {
+		GstClock *clock = gst_element_get_clock(pipeline_);
+		if (!clock)
+			return GST_CLOCK_TIME_NONE;
+		GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(pipeline_);
+		gst_object_unref(clock);
+		return now;
+	}
+
+	double Sensor2D::bufferAge(GstBuffer *buffer) {
+		if (!buffer || !GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)))
+			return -1;
+		GstClockTime now = runningTime();
+		if (!GST_CLOCK_TIME_IS_VALID(now))
+			return -1;
+		// Live sources stamp buffers with the running time of their arrival
+		return ((double)now - (double)GST_BUFFER_PTS(buffer)) / GST_SECOND;
+	}
+
+	ros::Time Sensor2D::getStamp(GstBuffer *buffer) {
+		if (stampSource_ == "rtcp" && ntpCaps_) {
+			// Capture time on the sender's clock, from the RTCP sender reports
+			GstReferenceTimestampMeta *meta =
+				gst_buffer_get_reference_timestamp_meta(buffer, ntpCaps_);
+			if (meta) {
+				const guint64 ntpToUnix = G_GUINT64_CONSTANT(2208988800) * GST_SECOND;
+				if (meta->timestamp > ntpToUnix)
+					return ros::Time().fromNSec(meta->timestamp - ntpToUnix);
 			}
-			
-      sampleBuffer = gst_sample_get_buffer(sample);
-      if(sampleBuffer != NULL)
-      {
-          gst_buffer_map(sampleBuffer, &bufferInfo, GST_MAP_READ);
-					//dis->header.seq = frame->frameCounter;
-        	//dis->header.stamp.sec = frame->timeStamp;
-        	rgb->height = height;
-        	rgb->width = width;
-        	rgb->encoding = sensor_msgs::image_encodings::BGR8;
-        	rgb->step = width*(sizeof(unsigned char)*3);
-        	rgb->data.resize(bufferInfo.size);
-        	memcpy ( &rgb->data[0], bufferInfo.data, bufferInfo.size );
-
-         sensor_msgs::CameraInfoPtr ci_rgb(
-         		new sensor_msgs::CameraInfo(cim_rgb_.getCameraInfo()));
-					ci_rgb->header.frame_id = nodeName_+"/sensor2d";
-					rgb->header.frame_id = nodeName_+"/sensor2d";
-
-					pub_rgb_.publish(rgb,ci_rgb);
-      }
-      gst_buffer_unmap (sampleBuffer, &bufferInfo);
-		  gst_sample_unref(sample);
-		 }
-		  return;
+		}
+		if (stampSource_ != "publish" && GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer))) {
+			// The pipeline runs on the real time clock, so base time plus
+			// PTS is the wall time the first packet of the frame arrived
+			GstClockTime base = gst_element_get_base_time(pipeline_);
+			return ros::Time().fromNSec(base + GST_BUFFER_PTS(buffer));
+		}
+		return ros::Time::now();
+	}
+
+	GstPadProbeReturn Sensor2D::decodeProbe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+		Sensor2D *self = static_cast<Sensor2D *>(data);
+		GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+		if (!GST_CLOCK_TIME_IS_VALID(GST_BUFFER_PTS(buffer)))
+			return GST_PAD_PROBE_OK;
+		boost::mutex::scoped_lock lock(self->stats_mutex_);
+		self->decodeStart_.push_back(std::make_pair(GST_BUFFER_PTS(buffer), self->runningTime()));
+		if (self->decodeStart_.size() > 64)
+			self->decodeStart_.pop_front();
+		return GST_PAD_PROBE_OK;
+	}
+
+	double Sensor2D::decodeTime(GstBuffer *buffer) {
+		GstClockTime now = runningTime();
+		boost::mutex::scoped_lock lock(stats_mutex_);
+		for (size_t i = 0; i < decodeStart_.size(); i++) {
+			if (decodeStart_[i].first == GST_BUFFER_PTS(buffer) &&
+					GST_CLOCK_TIME_IS_VALID(now) && GST_CLOCK_TIME_IS_VALID(decodeStart_[i].second))
+				return ((double)now - (double)decodeStart_[i].second) / GST_SECOND;
+		}
+		return -1;
+	}
+
+	void Sensor2D::addLatency(LatencyStats &stats, double age) {
+		if (age < 0)
+			return;
+		boost::mutex::scoped_lock lock(stats_mutex_);
+		stats.frames++;
+		stats.sum += age;
+		stats.max = std::max(stats.max, age);
+	}
+
+	void Sensor2D::publishStats(const ros::WallTimerEvent &event) {
+		if (pub_stats_.getNumSubscribers() == 0)
+			return;
+		LatencyStats raw, h264, jitter, decode;
+		{
+			boost::mutex::scoped_lock lock(stats_mutex_);
+			raw = rawLatency_;
+			h264 = h264Latency_;
+			jitter = jitterDelay_;
+			decode = decodeLatency_;
+			rawLatency_ = h264Latency_ = jitterDelay_ = decodeLatency_ = LatencyStats();
+		}
+
+		diagnostic_msgs::DiagnosticArrayPtr stats(new diagnostic_msgs::DiagnosticArray);
+		stats->header.stamp = ros::Time::now();
+		diagnostic_msgs::DiagnosticStatus status;
+		status.name = nodeName_ + "/sensor2d";
+		status.level = diagnostic_msgs::DiagnosticStatus::OK;
+		addValue(status, "frames", raw.frames);
+		addValue(status, "latency [ms]", raw.frames ? 1000.*raw.sum/raw.frames : 0.);
+		addValue(status, "max latency [ms]", 1000.*raw.max);
+		addValue(status, "h264 frames", h264.frames);
+		addValue(status, "h264 latency [ms]", h264.frames ? 1000.*h264.sum/h264.frames : 0.);
+		addValue(status, "h264 max latency [ms]", 1000.*h264.max);
+		addValue(status, "jitter buffer delay [ms]", jitter.frames ? 1000.*jitter.sum/jitter.frames : 0.);
+		addValue(status, "max jitter buffer delay [ms]", 1000.*jitter.max);
+		addValue(status, "decode latency [ms]", decode.frames ? 1000.*decode.sum/decode.frames : 0.);
+		addValue(status, "max decode latency [ms]", 1000.*decode.max);
+		addValue(status, "stamp source", stampSource_);
+		{
+			boost::mutex::scoped_lock lock(stats_mutex_);
+			addValue(status, "receiving", (bool)receiving_);
+			addValue(status, "outages", outages_);
+			if (!receiving_) {
+				status.level = diagnostic_msgs::DiagnosticStatus::ERROR;
+				status.message = "No stream";
+			}
+		}
+		addValue(status, "format", format_);
+		addValue(status, "low latency profile", lowLatency_);
+		addValue(status, "decoder threads", decoderThreads_);
+		addValue(status, "skip-frame", skipFrame_);
+		addValue(status, "convert threads", convertThreads_);
+		addValue(status, "max-buffers", maxBuffers_);
+		addValue(status, "drop", drop_);
+		addValue(status, "sync", sync_);
+		addValue(status, "jitter buffer latency [ms]", latency_);
+		addValue(status, "drop-on-latency", dropOnLatency_);
+		stats->status.push_back(status);
+		pub_stats_.publish(stats);
 	}
 	
 }
-
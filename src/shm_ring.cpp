@@ -0,0 +1,254 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/shm_ring.hpp>
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace bta_tof_driver {
+
+static const char shmMagic[8] = { 'B', 'T', 'A', 'S', 'H', 'M', 'R', '1' };
+static const uint32_t shmVersion = 1;
+
+// Slots start at cache line boundaries
+static uint64_t slotStride(uint64_t slotSize)
+{
+    return (sizeof(ShmSlotHeader) + slotSize + 63) & ~(uint64_t)63;
+}
+
+static size_t headerSize()
+{
+    return (sizeof(ShmRingHeader) + 63) & ~(size_t)63;
+}
+
+ShmRingWriter::ShmRingWriter(const std::string &name, uint32_t slots, uint64_t slotSize) :
+    name_(name),
+    slots_(slots),
+    slotSize_(slotSize),
+    mapSize_(headerSize() + slots*slotStride(slotSize)),
+    base_(NULL),
+    next_(0),
+    pendingSize_(0)
+{
+    // Start from scratch. Readers still mapping an old ring notice the
+    // cleared magic or, after a crash, the new inode (ShmRingReader::open)
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+	return;
+    if (ftruncate(fd, mapSize_) == 0) {
+	void *base = mmap(NULL, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base != MAP_FAILED)
+	    base_ = static_cast<uint8_t *>(base);
+    }
+    ::close(fd);
+    if (!base_) {
+	shm_unlink(name_.c_str());
+	return;
+    }
+
+    ShmRingHeader *header = reinterpret_cast<ShmRingHeader *>(base_);
+    header->version = shmVersion;
+    header->slots = slots_;
+    header->slotSize = slotSize_;
+    for (uint32_t i = 0; i < slots_; i++)
+	memset(getSlot(i), 0, sizeof(ShmSlotHeader));
+    // The magic last, a reader never sees a half initialized ring
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, shmMagic, sizeof(shmMagic));
+}
+
+ShmRingWriter::~ShmRingWriter()
+{
+    if (!base_)
+	return;
+    // Readers keep their mapping; tell them the ring is gone
+    ShmRingHeader *header = reinterpret_cast<ShmRingHeader *>(base_);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memset(header->magic, 0, sizeof(header->magic));
+    munmap(base_, mapSize_);
+    shm_unlink(name_.c_str());
+}
+
+ShmSlotHeader *ShmRingWriter::getSlot(uint32_t slot)
+{
+    return reinterpret_cast<ShmSlotHeader *>(base_ + headerSize() + slot*slotStride(slotSize_));
+}
+
+uint8_t *ShmRingWriter::begin(uint64_t size, uint32_t &slot)
+{
+    if (!base_ || size > slotSize_)
+	return NULL;
+    slot = next_;
+    next_ = (next_ + 1) % slots_;
+    ShmSlotHeader *header = getSlot(slot);
+    // Odd while writing
+    uint64_t sequence = __atomic_load_n(&header->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->sequence, sequence | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    pendingSize_ = size;
+    return reinterpret_cast<uint8_t *>(header + 1);
+}
+
+uint64_t ShmRingWriter::commit(uint32_t slot, const ShmSlotHeader &header)
+{
+    ShmSlotHeader *target = getSlot(slot);
+    uint64_t sequence = __atomic_load_n(&target->sequence, __ATOMIC_RELAXED) + 1;
+    memcpy(reinterpret_cast<uint8_t *>(target) + sizeof(target->sequence),
+	   reinterpret_cast<const uint8_t *>(&header) + sizeof(header.sequence),
+	   sizeof(ShmSlotHeader) - sizeof(header.sequence));
+    target->size = pendingSize_;
+    __atomic_store_n(&target->sequence, sequence, __ATOMIC_RELEASE);
+    return sequence;
+}
+
+ShmRingReader::ShmRingReader() :
+    mapSize_(0),
+    base_(NULL),
+    slots_(0),
+    slotSize_(0),
+    device_(0),
+    inode_(0)
+{
+}
+
+ShmRingReader::~ShmRingReader()
+{
+    close();
+}
+
+bool ShmRingReader::open(const std::string &name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+	close();
+	return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	::close(fd);
+	close();
+	return false;
+    }
+    // Still the same object, and its writer did not close it
+    if (base_ && name == name_ && st.st_dev == device_ && st.st_ino == inode_ &&
+	    memcmp(base_, shmMagic, sizeof(shmMagic)) == 0) {
+	::close(fd);
+	return true;
+    }
+    close();
+
+    void *base = MAP_FAILED;
+    if ((size_t)st.st_size >= headerSize())
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+	return false;
+
+    const ShmRingHeader *header = static_cast<const ShmRingHeader *>(base);
+    if (memcmp(header->magic, shmMagic, sizeof(shmMagic)) != 0 ||
+	    header->version != shmVersion ||
+	    headerSize() + header->slots*slotStride(header->slotSize) > (size_t)st.st_size) {
+	munmap(base, st.st_size);
+	return false;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    name_ = name;
+    device_ = st.st_dev;
+    inode_ = st.st_ino;
+    mapSize_ = st.st_size;
+    base_ = static_cast<const uint8_t *>(base);
+    slots_ = header->slots;
+    slotSize_ = header->slotSize;
+    return true;
+}
+
+void ShmRingReader::close()
+{
+    if (base_)
+	munmap(const_cast<uint8_t *>(base_), mapSize_);
+    base_ = NULL;
+    name_.clear();
+}
+
+const ShmSlotHeader *ShmRingReader::getSlot(uint32_t slot) const
+{
+    return reinterpret_cast<const ShmSlotHeader *>(base_ + headerSize() + slot*slotStride(slotSize_));
+}
+
+const uint8_t *ShmRingReader::get(uint32_t slot, uint64_t sequence, ShmSlotHeader &header) const
+{
+    if (!base_ || slot >= slots_)
+	return NULL;
+    const ShmSlotHeader *source = getSlot(slot);
+    if (__atomic_load_n(&source->sequence, __ATOMIC_ACQUIRE) != sequence)
+	return NULL;
+    memcpy(&header, source, sizeof(header));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (!isValid(slot, sequence) || header.size > slotSize_)
+	return NULL;
+    return reinterpret_cast<const uint8_t *>(source + 1);
+}
+
+bool ShmRingReader::isValid(uint32_t slot, uint64_t sequence) const
+{
+    if (!base_ || slot >= slots_)
+	return false;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&getSlot(slot)->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+bool ShmRingReader::copy(uint32_t slot, uint64_t sequence, ShmSlotHeader &header,
+			 std::vector<uint8_t> &data) const
+{
+    const uint8_t *payload = get(slot, sequence, header);
+    if (!payload)
+	return false;
+    data.assign(payload, payload + header.size);
+    return isValid(slot, sequence);
+}
+
+}
@@ -0,0 +1,182 @@
+/******************************************************************************
+ * Copyright (c) 2016
+ * VoXel Interaction Design GmbH
+ *
+ * @author Angel Merino Sastre
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ ******************************************************************************/
+
+/** @mainpage Bta ROS driver
+ *
+ * @section intro_sec Introduction
+ *
+ * This software defines a interface for working with all ToF cameras from
+ * Bluetechnix GmbH supported by their API.
+ *
+ * @section install_sec Installation
+ *
+ * We encorage you to follow the instruction we prepared in:
+ *
+ * ROS wiki: http://wiki.ros.org/bta_tof_driver
+ * Github repository: https://github.com/voxel-dot-at/bta_tof_driver
+ *
+ */
+
+#include <bta_tof_driver/shm_ring.hpp>
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+
+using namespace bta_tof_driver;
+
+// A name of its own per process, tests may run in parallel
+static std::string ringName()
+{
+    std::ostringstream ss;
+    ss << "/bta_tof_driver_test_" << getpid();
+    return ss.str();
+}
+
+static uint64_t writeFrame(ShmRingWriter &writer, uint8_t value, uint64_t size, uint32_t &slot)
+{
+    uint8_t *data = writer.begin(size, slot);
+    if (!data)
+	return 0;
+    memset(data, value, size);
+    ShmSlotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.frameCounter = value;
+    return writer.commit(slot, header);
+}
+
+TEST(ShmRing, ReadsCommittedSlot)
+{
+    ShmRingWriter writer(ringName(), 2, 64);
+    ASSERT_TRUE(writer.isOpen());
+    uint32_t slot;
+    uint64_t sequence = writeFrame(writer, 7, 16, slot);
+    EXPECT_EQ(0u, sequence & 1);
+
+    ShmRingReader reader;
+    ASSERT_TRUE(reader.open(ringName()));
+    ShmSlotHeader header;
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(reader.copy(slot, sequence, header, data));
+    EXPECT_EQ(7u, header.frameCounter);
+    EXPECT_EQ(16u, header.size);
+    ASSERT_EQ(16u, data.size());
+    EXPECT_EQ(7, data[15]);
+}
+
+TEST(ShmRing, SlotBeingWrittenIsInvalid)
+{
+    ShmRingWriter writer(ringName(), 1, 64);
+    uint32_t slot;
+    uint64_t sequence = writeFrame(writer, 1, 8, slot);
+
+    ShmRingReader reader;
+    ASSERT_TRUE(reader.open(ringName()));
+    ShmSlotHeader header;
+    ASSERT_TRUE(reader.get(slot, sequence, header) != NULL);
+    // The writer starts over the slot while the reader still uses it
+    ASSERT_TRUE(writer.begin(8, slot) != NULL);
+    EXPECT_FALSE(reader.isValid(slot, sequence));
+    EXPECT_TRUE(reader.get(slot, sequence, header) == NULL);
+}
+
+TEST(ShmRing, OverwrittenSlotIsRejected)
+{
+    ShmRingWriter writer(ringName(), 2, 64);
+    uint32_t first, slot;
+    uint64_t old = writeFrame(writer, 1, 8, first);
+    writeFrame(writer, 2, 8, slot);
+    uint64_t sequence = writeFrame(writer, 3, 8, slot);
+    ASSERT_EQ(first, slot);
+
+    ShmRingReader reader;
+    ASSERT_TRUE(reader.open(ringName()));
+    ShmSlotHeader header;
+    std::vector<uint8_t> data;
+    EXPECT_FALSE(reader.copy(first, old, header, data));
+    ASSERT_TRUE(reader.copy(slot, sequence, header, data));
+    EXPECT_EQ(3u, header.frameCounter);
+}
+
+TEST(ShmRing, OversizeFrameDoesNotFit)
+{
+    ShmRingWriter writer(ringName(), 2, 64);
+    uint32_t slot = 5;
+    EXPECT_TRUE(writer.begin(65, slot) == NULL);
+    EXPECT_EQ(5u, slot);
+}
+
+TEST(ShmRing, ReaderFollowsRestartedWriter)
+{
+    ShmRingReader reader;
+    uint32_t slot;
+    uint64_t sequence;
+    {
+	ShmRingWriter writer(ringName(), 2, 64);
+	sequence = writeFrame(writer, 1, 8, slot);
+	ASSERT_TRUE(reader.open(ringName()));
+    }
+    // The closed ring is not reported open any more
+    EXPECT_FALSE(reader.open(ringName()));
+
+    ShmRingWriter writer(ringName(), 2, 64);
+    uint64_t next = writeFrame(writer, 9, 8, slot);
+    ASSERT_TRUE(reader.open(ringName()));
+    ShmSlotHeader header;
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(reader.copy(slot, next, header, data));
+    EXPECT_EQ(9u, header.frameCounter);
+    // Sequences start over with the ring, only remapping tells them apart
+    EXPECT_EQ(sequence, next);
+}
+
+TEST(ShmRing, ReaderRemapsReplacedRing)
+{
+    // A writer that died without closing leaves the magic in place
+    ShmRingWriter *old = new ShmRingWriter(ringName(), 2, 64);
+    uint32_t slot;
+    writeFrame(*old, 1, 8, slot);
+    ShmRingReader reader;
+    ASSERT_TRUE(reader.open(ringName()));
+
+    ShmRingWriter writer(ringName(), 2, 64);
+    uint64_t sequence = writeFrame(writer, 4, 8, slot);
+    ASSERT_TRUE(reader.open(ringName()));
+    ShmSlotHeader header;
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(reader.copy(slot, sequence, header, data));
+    EXPECT_EQ(4u, header.frameCounter);
+    // Leak the old writer's mapping on purpose; deleting it would unlink
+    // the new ring
+    (void)old;
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}